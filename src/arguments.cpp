@@ -9,6 +9,8 @@ namespace Arguments
 	bool noValidation = false;
 	bool noBackgroundTransfer = false;
 	bool noVkExtensions = false;
+	bool compactWorld = false;
+	bool noIOUring = false;
 	
 	void Parse(int argc, char** argv)
 	{
@@ -28,6 +30,16 @@ namespace Arguments
 			{
 				noVkExtensions = true;
 			}
+			
+			if (std::strcmp(argv[i], "--compact-world") == 0)
+			{
+				compactWorld = true;
+			}
+			
+			if (std::strcmp(argv[i], "--no-io-uring") == 0)
+			{
+				noIOUring = true;
+			}
 		}
 	}
 }
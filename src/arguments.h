@@ -8,6 +8,12 @@ namespace Arguments
 	extern bool noBackgroundTransfer;
 	extern bool noVkExtensions;
 	
+	//Compacts the region containers of the world and exits, without starting the game.
+	extern bool compactWorld;
+	
+	//Reads regions with blocking reads even if io_uring is available.
+	extern bool noIOUring;
+	
 	void Parse(int argc, char** argv);
 }
 }
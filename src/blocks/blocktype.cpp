@@ -1,15 +1,19 @@
 #include "blocktype.h"
-#include "blockstexturemanager.h"
 #include "sides.h"
 #include "../utils.h"
 
 #include <fstream>
 #include <algorithm>
 
+#ifndef MCR_HEADLESS
+#include "blockstexturemanager.h"
+#endif
+
 namespace MCR
 {
 	BlockType BlockType::s_blockTypes[256];
 	
+#ifndef MCR_HEADLESS
 	static void ParseTextures(const nlohmann::json& json, int* albedoTextureIndices, int* normalTextureIndices)
 	{
 		BlocksTextureManager& blocksTextureManager = BlocksTextureManager::GetInstance();
@@ -72,6 +76,7 @@ namespace MCR
 			}
 		}
 	}
+#endif
 	
 	void BlockType::Parse(const nlohmann::json& json)
 	{
@@ -96,12 +101,14 @@ namespace MCR
 			m_roughness = glm::clamp(roughnessIt->get<float>(), 0.0f, 1.0f);
 		}
 		
-		//Parses textures
+		//Parses textures, headless builds have no texture manager and don't render blocks
+#ifndef MCR_HEADLESS
 		auto textureIt = json.find("texture");
 		if (textureIt != json.end())
 		{
 			ParseTextures(*textureIt, m_albedoTextureIndices, m_normalTextureIndices);
 		}
+#endif
 	}
 	
 	void BlockType::RegisterJSON(const nlohmann::json& json)
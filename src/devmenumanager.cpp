@@ -2,8 +2,10 @@
 #include "ui/devmenubar.h"
 #include "ui/profilingpane.h"
 #include "timemanager.h"
+#include "world/worldmanager.h"
 
 #include <memory>
+#include <algorithm>
 
 namespace MCR
 {
@@ -11,7 +13,8 @@ namespace MCR
 	
 	static float g_timeScale = 100;
 	
-	void InitDevMenu(Renderer& renderer, ProfilingPane& profilingPane, TimeManager& timeManager)
+	void InitDevMenu(Renderer& renderer, ProfilingPane& profilingPane, TimeManager& timeManager,
+	                 WorldManager& worldManager)
 	{
 		devMenuBar = std::make_unique<DevMenuBar>();
 		
@@ -49,6 +52,119 @@ namespace MCR
 		                         [&] (bool freezeTime) { timeManager.SetFreezeTime(freezeTime); });
 		
 		devMenuBar->AddMenu("Time", std::make_unique<DevMenu>(std::move(timeMenu)));
+		
+		const float bytesPerMiB = 1024.0f * 1024.0f;
+		
+		DevMenu worldMenu;
+		worldMenu.AddValue<float>("Region Memory (MiB)", [&]
+		{
+			size_t denseBytes;
+			return worldManager.GetRegionMemoryUsage(denseBytes) / bytesPerMiB;
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Dense Region Memory (MiB)", [&]
+		{
+			size_t denseBytes;
+			worldManager.GetRegionMemoryUsage(denseBytes);
+			return denseBytes / bytesPerMiB;
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Region Pool Hits", [&]
+		{
+			return static_cast<float>(worldManager.GetRegionPool().GetHits());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Region Pool Misses", [&]
+		{
+			return static_cast<float>(worldManager.GetRegionPool().GetMisses());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Region Cache Size (MiB)", [&]
+		{
+			return worldManager.GetRegionCache().GetCapacity() / bytesPerMiB;
+		}, [&] (float capacity)
+		{
+			worldManager.GetRegionCache().SetCapacity(static_cast<size_t>(std::max(capacity, 0.0f) * bytesPerMiB));
+		});
+		worldMenu.AddValue<float>("Region Cache Used (MiB)", [&]
+		{
+			return worldManager.GetRegionCache().GetMemoryUsage() / bytesPerMiB;
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Region Cache Hit Rate", [&]
+		{
+			const RegionCache& regionCache = worldManager.GetRegionCache();
+			const uint64_t lookups = regionCache.GetHits() + regionCache.GetMisses();
+			return lookups == 0 ? 0.0f : static_cast<float>(regionCache.GetHits()) / lookups;
+		}, [] (float) { });
+		worldMenu.AddValue<float>("IO Merged Saves", [&]
+		{
+			const RegionIOThread* ioThread = worldManager.GetIOThread();
+			return ioThread == nullptr ? 0.0f : static_cast<float>(ioThread->GetNumMergedSaves());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("IO In-Flight Loads", [&]
+		{
+			const RegionIOThread* ioThread = worldManager.GetIOThread();
+			return ioThread == nullptr ? 0.0f : static_cast<float>(ioThread->GetNumInFlightLoads());
+		}, [] (float) { });
+		worldMenu.AddValue<bool>("Vertical Streaming", [&] { return worldManager.IsVerticalStreamingEnabled(); },
+		                         [&] (bool enabled) { worldManager.SetVerticalStreaming(enabled); });
+		worldMenu.AddValue<float>("Vertical Distance", [&]
+		{
+			return static_cast<float>(worldManager.GetVerticalStreamingDistance());
+		}, [&] (float distance)
+		{
+			worldManager.SetVerticalStreamingDistance(std::max(static_cast<int>(distance), 0));
+		});
+		worldMenu.AddValue<float>("Chunk Meshes", [&]
+		{
+			return static_cast<float>(worldManager.GetNumChunkMeshes());
+		}, [] (float) { });
+		worldMenu.AddValue<bool>("Prefetch Regions", [&] { return worldManager.IsPrefetchEnabled(); },
+		                         [&] (bool enabled) { worldManager.SetPrefetchEnabled(enabled); });
+		worldMenu.AddValue<float>("Prefetched Regions", [&]
+		{
+			return static_cast<float>(worldManager.GetNumPrefetchedRegions());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Prefetch Hits", [&]
+		{
+			return static_cast<float>(worldManager.GetNumPrefetchHits());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Frames Missing Meshes", [&]
+		{
+			return static_cast<float>(worldManager.GetNumFramesMissingMeshes());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Generation Queue Length", [&]
+		{
+			return static_cast<float>(worldManager.GetGenerateThread().GetNumPending());
+		}, [] (float) { });
+		worldMenu.AddValue<float>("Cancelled Generations", [&]
+		{
+			return static_cast<float>(worldManager.GetGenerateThread().GetNumCancelled());
+		}, [] (float) { });
+		worldMenu.AddValue<bool>("Coarse Terrain Density", [&]
+		{
+			return worldManager.GetGenerator().IsCoarseDensityEnabled();
+		}, [&] (bool enabled)
+		{
+			worldManager.GetGenerator().SetCoarseDensity(enabled);
+		});
+		worldMenu.AddValue<bool>("Split Region Generation", [&]
+		{
+			return worldManager.GetGenerateThread().IsSplittingRegions();
+		}, [&] (bool enabled)
+		{
+			worldManager.GetGenerateThread().SetSplitRegions(enabled);
+		});
+		worldMenu.AddValue<bool>("Cache Noise Tiles", [&]
+		{
+			return worldManager.GetGenerator().IsNoiseTileCacheEnabled();
+		}, [&] (bool enabled)
+		{
+			worldManager.GetGenerator().SetNoiseTileCacheEnabled(enabled);
+		});
+		worldMenu.AddAction("Benchmark Connectivity", [] { Region::BenchmarkConnectivity(1000); });
+		worldMenu.AddAction("Benchmark Region IO", [] { World::BenchmarkRegionIO(16); });
+		worldMenu.AddAction("Compare Density Sampling", [] { WorldGenerator::CompareDensitySampling(16); });
+		worldMenu.AddAction("Compare Perlin Noise", [] { PerlinNoise::CompareWithLibnoise(1 << 18); });
+		worldMenu.AddAction("Benchmark First Ring", [] { RegionGenerateThread::BenchmarkFirstRing(4); });
+		
+		devMenuBar->AddMenu("World", std::make_unique<DevMenu>(std::move(worldMenu)));
 	}
 	
 	void DestroyDevMenu()
@@ -7,7 +7,8 @@
 
 namespace MCR
 {
-	void InitDevMenu(Renderer& renderer, class ProfilingPane& profilingPane, class TimeManager& timeManager);
+	void InitDevMenu(Renderer& renderer, class ProfilingPane& profilingPane, class TimeManager& timeManager,
+	                 class WorldManager& worldManager);
 	void DestroyDevMenu();
 	
 	void RenderDevMenu(UIDrawList& drawList, glm::ivec2 screenSize);
@@ -123,7 +123,7 @@ namespace MCR
 		worldManager->SetRenderDistance(settings.GetRenderDistance());
 		renderer.SetWorldManager(worldManager.get());
 		
-		InitDevMenu(renderer, profilingPane, timeManager);
+		InitDevMenu(renderer, profilingPane, timeManager, *worldManager);
 		
 		const fs::path worldPath = MCR::GetResourcePath() / "world";
 		if (!fs::exists(worldPath))
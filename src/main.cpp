@@ -13,6 +13,7 @@
 #include "rendering/shaders/shader.h"
 #include "ui/font.h"
 #include "vulkan/library.h"
+#include "world/world.h"
 
 #undef main
 
@@ -24,6 +25,16 @@ int main(int argc, char** argv)
 {
 	MCR::Arguments::Parse(argc, argv);
 	
+	if (MCR::Arguments::compactWorld)
+	{
+		const fs::path worldPath = MCR::GetResourcePath() / "world";
+		if (fs::exists(worldPath))
+		{
+			MCR::World::CompactContainers(worldPath);
+		}
+		return 0;
+	}
+	
 	if (SDL_Init(SDL_INIT_VIDEO) != 0)
 	{
 		std::cerr << SDL_GetError() << "\n";
@@ -0,0 +1,313 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <unordered_map>
+
+#include "../world/world.h"
+#include "../world/worldgenerator.h"
+#include "../utils.h"
+
+namespace MCR
+{
+	struct PregenOptions
+	{
+		fs::path m_worldPath;
+		
+		int64_t m_width = 0;
+		int64_t m_depth = 0;
+		
+		//The region with the smallest coordinates, the rectangle is centered on region (0, 0) by default.
+		int64_t m_originX = 0;
+		int64_t m_originZ = 0;
+		bool m_hasOrigin = false;
+		
+		uint32_t m_numThreads = 0;
+		
+		bool m_coarseDensity = false;
+	};
+	
+	using RegionMap = std::unordered_map<RegionCoordinate, std::unique_ptr<Region>, RegionCoordinateHash>;
+	
+	//Calls callback with each index in [0, count) using numThreads threads, including the calling thread. An
+	//exception thrown by the callback is rethrown once all threads have stopped.
+	template <typename CallbackTp>
+	static void ParallelFor(size_t count, uint32_t numThreads, CallbackTp callback)
+	{
+		std::atomic<size_t> nextIndex { 0 };
+		
+		std::mutex exceptionMutex;
+		std::exception_ptr exception;
+		
+		auto threadTarget = [&]
+		{
+			try
+			{
+				for (size_t i = nextIndex++; i < count; i = nextIndex++)
+				{
+					callback(i);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(exceptionMutex);
+				exception = std::current_exception();
+				nextIndex = count;
+			}
+		};
+		
+		std::vector<std::thread> threads;
+		for (uint32_t i = 1; i < numThreads && i < count; i++)
+		{
+			threads.emplace_back(threadTarget);
+		}
+		
+		threadTarget();
+		
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+	
+	static void SaveRegions(World& world, const std::vector<Region*>& regions, uint32_t numThreads)
+	{
+		ParallelFor(regions.size(), numThreads, [&] (size_t i)
+		{
+			world.SaveRegion(*regions[i]);
+		});
+	}
+	
+	//Generates a rectangle of regions into a world directory without opening a window, so that large worlds can be
+	//prepared on machines without a GPU. The world can then be opened by the renderer.
+	static void Pregenerate(const PregenOptions& options)
+	{
+		using Clock = std::chrono::steady_clock;
+		
+		if (!fs::exists(options.m_worldPath))
+		{
+			fs::create_directories(options.m_worldPath);
+		}
+		
+		World world(options.m_worldPath);
+		WorldGenerator generator;
+		generator.SetCoarseDensity(options.m_coarseDensity);
+		
+		const int64_t minX = options.m_hasOrigin ? options.m_originX : -options.m_width / 2;
+		const int64_t minZ = options.m_hasOrigin ? options.m_originZ : -options.m_depth / 2;
+		const int64_t maxZ = minZ + options.m_depth;
+		
+		//Regions are generated in bands of rows, with enough regions per band to keep every thread busy. Blocks
+		//placed in neighboring regions (leaves and caves crossing region borders) are applied once the next band has
+		//been generated, so a band is only saved after the band following it is done.
+		const int64_t regionsPerBand = options.m_numThreads * 4;
+		const int64_t bandRows = std::max<int64_t>((regionsPerBand + options.m_width - 1) / options.m_width, 1);
+		
+		RegionMap regions;
+		auto getRegion = [&] (RegionCoordinate coordinate) -> Region*
+		{
+			auto it = regions.find(coordinate);
+			return it == regions.end() ? nullptr : it->second.get();
+		};
+		
+		auto saveRows = [&] (int64_t beginZ, int64_t endZ)
+		{
+			std::vector<std::unique_ptr<Region>> rowRegions;
+			std::vector<Region*> regionsToSave;
+			for (auto it = regions.begin(); it != regions.end();)
+			{
+				if (it->first.z < beginZ || it->first.z >= endZ)
+				{
+					++it;
+					continue;
+				}
+				
+				regionsToSave.push_back(it->second.get());
+				rowRegions.push_back(std::move(it->second));
+				it = regions.erase(it);
+			}
+			
+			SaveRegions(world, regionsToSave, options.m_numThreads);
+		};
+		
+		Clock::duration generateTime { };
+		size_t numGenerated = 0;
+		size_t numSkipped = 0;
+		
+		const Clock::time_point startTime = Clock::now();
+		
+		for (int64_t bandZ = minZ; bandZ < maxZ; bandZ += bandRows)
+		{
+			const int64_t bandEndZ = std::min(bandZ + bandRows, maxZ);
+			
+			//Regions which are already saved are kept, so that an interrupted run can be resumed.
+			std::vector<Region*> bandRegions;
+			for (int64_t z = bandZ; z < bandEndZ; z++)
+			{
+				for (int64_t x = minX; x < minX + options.m_width; x++)
+				{
+					if (world.HasRegion(x, z))
+					{
+						numSkipped++;
+						continue;
+					}
+					
+					std::unique_ptr<Region>& region = regions[{ x, z }];
+					region = std::make_unique<Region>(x, z);
+					bandRegions.push_back(region.get());
+				}
+			}
+			
+			const Clock::time_point generateStartTime = Clock::now();
+			
+			ParallelFor(bandRegions.size(), options.m_numThreads, [&] (size_t i)
+			{
+				generator.Generate(*bandRegions[i]);
+			});
+			
+			generateTime += Clock::now() - generateStartTime;
+			numGenerated += bandRegions.size();
+			
+			generator.ProcessFutureRegions(getRegion, [] (RegionCoordinate) { });
+			
+			if (bandZ != minZ)
+			{
+				saveRows(bandZ - bandRows, bandZ);
+			}
+			
+			Log("Generated ", numGenerated + numSkipped, "/", options.m_width * options.m_depth, " regions");
+		}
+		
+		saveRows(minZ, maxZ);
+		
+		//Blocks can still be waiting for regions which were saved before the blocks were placed (by caves spanning
+		//more than one band) or which already existed. These regions are loaded again, updated and saved.
+		RegionMap savedRegions;
+		generator.ProcessFutureRegions([&] (RegionCoordinate coordinate) -> Region*
+		{
+			if (!world.HasRegion(coordinate.x, coordinate.z))
+				return nullptr;
+			
+			std::unique_ptr<Region>& region = savedRegions[coordinate];
+			if (region == nullptr)
+			{
+				region = std::make_unique<Region>(coordinate.x, coordinate.z);
+				world.LoadRegion(*region);
+			}
+			return region.get();
+		}, [] (RegionCoordinate) { });
+		
+		std::vector<Region*> regionsToUpdate;
+		for (auto& savedRegion : savedRegions)
+		{
+			regionsToUpdate.push_back(savedRegion.second.get());
+		}
+		SaveRegions(world, regionsToUpdate, options.m_numThreads);
+		
+		world.Save();
+		
+		using Seconds = std::chrono::duration<double>;
+		const double totalSeconds = std::chrono::duration_cast<Seconds>(Clock::now() - startTime).count();
+		const double generateSeconds = std::chrono::duration_cast<Seconds>(generateTime).count();
+		
+		Log("Generated ", numGenerated, " regions (", numSkipped, " already saved, ", regionsToUpdate.size(),
+		    " updated after saving) using ", options.m_numThreads, " threads");
+		
+		if (numGenerated != 0)
+		{
+			Log("Generation: ", generateSeconds, "s, ", numGenerated / generateSeconds, " regions/s");
+			Log("Total: ", totalSeconds, "s, ", numGenerated / totalSeconds, " regions/s");
+		}
+	}
+	
+	static bool ParseOptions(int argc, char** argv, PregenOptions& options)
+	{
+		if (argc < 3)
+			return false;
+		
+		try
+		{
+			options.m_width = std::stoll(argv[1]);
+			options.m_depth = std::stoll(argv[2]);
+			
+			for (int i = 3; i < argc; i++)
+			{
+				if (std::strcmp(argv[i], "--world") == 0 && i + 1 < argc)
+				{
+					options.m_worldPath = fs::u8path(argv[++i]);
+				}
+				else if (std::strcmp(argv[i], "--origin") == 0 && i + 2 < argc)
+				{
+					options.m_originX = std::stoll(argv[++i]);
+					options.m_originZ = std::stoll(argv[++i]);
+					options.m_hasOrigin = true;
+				}
+				else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+				{
+					options.m_numThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+				}
+				else if (std::strcmp(argv[i], "--coarse-density") == 0)
+				{
+					options.m_coarseDensity = true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+		}
+		catch (const std::logic_error&)
+		{
+			return false;
+		}
+		
+		if (options.m_width <= 0 || options.m_depth <= 0)
+			return false;
+		
+		//Uses the same world as the renderer by default.
+		if (options.m_worldPath.empty())
+		{
+			options.m_worldPath = GetResourcePath() / "world";
+		}
+		
+		if (options.m_numThreads == 0)
+		{
+			options.m_numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+		}
+		
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	MCR::PregenOptions options;
+	if (!MCR::ParseOptions(argc, argv, options))
+	{
+		std::cerr << "Usage: " << argv[0] << " <width> <depth> [--world <dir>] [--origin <x> <z>] [--threads <n>]"
+		             " [--coarse-density]\n"
+		             "Generates width x depth regions into the world directory (the renderer's world by default).\n";
+		return 1;
+	}
+	
+	MCR::SetThreadDesc(std::this_thread::get_id(), "Main");
+	
+	try
+	{
+		MCR::Pregenerate(options);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << ex.what() << "\n";
+		return 2;
+	}
+}
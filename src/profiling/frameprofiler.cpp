@@ -16,6 +16,7 @@ namespace MCR
 	{
 		m_numUsedGPUTimers = 0;
 		m_numUsedTimers = 0;
+		m_numUsedCounters = 0;
 	}
 	
 	void FrameProfiler::Reset(CommandBuffer& commandBuffer)
@@ -58,6 +59,20 @@ namespace MCR
 			std::chrono::high_resolution_clock::now() - m_timers[timerID].m_cpuStartTime);
 	}
 	
+	void FrameProfiler::SetCounter(std::string_view name, float value)
+	{
+		for (uint32_t i = 0; i < m_numUsedCounters; i++)
+		{
+			if (m_counters[i].m_name == name)
+			{
+				m_counters[i].m_value = value;
+				return;
+			}
+		}
+		
+		m_counters[m_numUsedCounters++] = { value, name };
+	}
+	
 	ProfilingData FrameProfiler::GetData(std::chrono::duration<float, std::milli> frameTime) const
 	{
 		uint64_t gpuTimestamps[MaxGPUTimers * 2];
@@ -90,7 +105,9 @@ namespace MCR
 			}
 		}
 		
-		return ProfilingData(std::move(durations), frameTime);
+		std::vector<ProfilingData::Counter> counters(m_counters.begin(), m_counters.begin() + m_numUsedCounters);
+		
+		return ProfilingData(std::move(durations), std::move(counters), frameTime);
 	}
 }
 
@@ -30,10 +30,15 @@ namespace MCR
 		
 		void EndCPUTimer(uint32_t timerID);
 		
+		//Records a value for the current frame, such as the length of a queue. Setting a counter again in the same
+		//frame replaces its value.
+		void SetCounter(std::string_view name, float value);
+		
 		ProfilingData GetData(std::chrono::duration<float, std::milli> frameTime) const;
 		
 		static constexpr uint32_t MaxGPUTimers = 32;
 		static constexpr uint32_t MaxCPUTimers = 32;
+		static constexpr uint32_t MaxCounters = 16;
 		
 	private:
 		struct TimerEntry
@@ -48,6 +53,9 @@ namespace MCR
 		std::array<TimerEntry, MaxCPUTimers + MaxGPUTimers> m_timers;
 		uint32_t m_numUsedTimers = 0;
 		
+		std::array<ProfilingData::Counter, MaxCounters> m_counters;
+		uint32_t m_numUsedCounters = 0;
+		
 		VkHandle<VkQueryPool> m_queryPool;
 		uint32_t m_numUsedGPUTimers = 0;
 	};
@@ -75,6 +83,11 @@ namespace MCR
 	{
 		currentFrameProfiler->EndCPUTimer(timerID);
 	}
+	
+	inline void SetProfilingCounter(std::string_view name, float value)
+	{
+		currentFrameProfiler->SetCounter(name, value);
+	}
 }
 
 #else
@@ -102,6 +115,11 @@ namespace MCR
 	{
 		
 	}
+	
+	inline void SetProfilingCounter(std::string_view, float)
+	{
+	
+	}
 }
 
 #endif
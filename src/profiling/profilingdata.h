@@ -19,10 +19,17 @@ namespace MCR
 			TimerTypes m_type;
 		};
 		
+		struct Counter
+		{
+			float m_value;
+			std::string_view m_name;
+		};
+		
 		ProfilingData() = default;
 		
-		inline ProfilingData(std::vector<Duration> durations, std::chrono::duration<float, std::milli> frameTime)
-		    : m_durations(durations), m_frameTime(frameTime) { }
+		inline ProfilingData(std::vector<Duration> durations, std::vector<Counter> counters,
+		                     std::chrono::duration<float, std::milli> frameTime)
+		    : m_durations(durations), m_counters(counters), m_frameTime(frameTime) { }
 		
 		inline std::vector<Duration>::const_iterator DurationsBegin() const
 		{
@@ -34,6 +41,16 @@ namespace MCR
 			return m_durations.cend();
 		}
 		
+		inline std::vector<Counter>::const_iterator CountersBegin() const
+		{
+			return m_counters.cbegin();
+		}
+		
+		inline std::vector<Counter>::const_iterator CountersEnd() const
+		{
+			return m_counters.cend();
+		}
+		
 		inline std::chrono::duration<float, std::milli> GetFrameTime() const
 		{
 			return m_frameTime;
@@ -41,6 +58,7 @@ namespace MCR
 		
 	private:
 		std::vector<Duration> m_durations;
+		std::vector<Counter> m_counters;
 		std::chrono::duration<float, std::milli> m_frameTime;
 	};
 }
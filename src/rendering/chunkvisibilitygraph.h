@@ -3,6 +3,7 @@
 #include <cstddef>
 
 #include "../world/region.h"
+#include "../vulkan/vk.h"
 
 namespace MCR
 {
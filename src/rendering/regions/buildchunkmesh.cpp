@@ -5,23 +5,172 @@
 
 namespace MCR
 {
+	//Returns the chunk next to the chunk being built on the given side, or null if that side faces out of the world.
+	static const Region::Chunk* GetNeighborChunk(const ChunkMeshBuildParams& params, int side)
+	{
+		switch (side)
+		{
+		case BLOCK_SIDE_POSX: return params.m_neighbors[NeighborPosX];
+		case BLOCK_SIDE_NEGX: return params.m_neighbors[NeighborNegX];
+		case BLOCK_SIDE_POSY: return params.m_chunkAbove;
+		case BLOCK_SIDE_NEGY: return params.m_chunkBelow;
+		case BLOCK_SIDE_POSZ: return params.m_neighbors[NeighborPosZ];
+		case BLOCK_SIDE_NEGZ: return params.m_neighbors[NeighborNegZ];
+		default: return nullptr;
+		}
+	}
+		
+	//Checks if the block in front of the given side of a block is opaque, the block position is relative to the chunk.
+	//Blocks below the world are treated as opaque and blocks above the world as not opaque.
+	static bool IsFrontBlockOpaque(const ChunkMeshBuildParams& params, glm::ivec3 blockPos, int side)
+	{
+		glm::ivec3 frontBlockPos = blockPos + BlockNormals[side];
+		
+		const Region::Chunk* frontChunk = params.m_chunk;
+		if (frontBlockPos.x < 0 || frontBlockPos.y < 0 || frontBlockPos.z < 0 || frontBlockPos.x >= Region::Size ||
+		    frontBlockPos.y >= Region::Size || frontBlockPos.z >= Region::Size)
+		{
+			frontChunk = GetNeighborChunk(params, side);
+			if (frontChunk == nullptr)
+				return side == BLOCK_SIDE_NEGY;
+			
+			//Wraps the position around to the other side of the neighboring chunk.
+			frontBlockPos -= BlockNormals[side] * Region::Size;
+		}
+		
+		return frontChunk->m_opaqueMask.Get(frontBlockPos.x, frontBlockPos.y, frontBlockPos.z);
+	}
+	
+	static void AddBlockFace(const ChunkMeshBuildParams& params, const BlockType& blockType,
+	                         const glm::vec3& blockWorldCenter, int s)
+	{
+		const glm::vec3 faceCenter = blockWorldCenter + glm::vec3(BlockNormals[s]) * 0.5f;
+		
+		const int albedoLayer = blockType.GetAlbedoTextureLayer(s);
+		const int normalLayer = blockType.GetNormalTextureLayer(s);
+		
+		const uint32_t baseIndex = params.m_meshBuilder->GetNextVertexIndex();
+		params.m_meshBuilder->AddTriangle(baseIndex + 0, baseIndex + 1, baseIndex + 2);
+		params.m_meshBuilder->AddTriangle(baseIndex + 2, baseIndex + 1, baseIndex + 3);
+		
+		const glm::vec3 up = BlockTangents[s];
+		const glm::vec3 left = BlockBiTangents[s];
+		
+		for (int vx = 0; vx < 2; vx++)
+		{
+			for (int vy = 0; vy < 2; vy++)
+			{
+				const glm::vec3 pos = faceCenter + up * (vy - 0.5f) + left * (vx - 0.5f);
+				params.m_meshBuilder->AddVertex(pos, BlockNormals[s], left, { vx, 1 - vy },
+				                                albedoLayer, normalLayer, blockType.GetRoughness(),
+				                                blockType.GetBendiness());
+			}
+		}
+	}
+	
+	//Builds the mesh for a chunk made up of a single opaque block type. Only blocks on the boundary of such a chunk
+	//can have visible faces, and entire sides can be skipped if the neighboring chunk is opaque.
+	static void BuildUniformOpaqueChunkMesh(const ChunkMeshBuildParams& params, const BlockType& blockType)
+	{
+		const int baseWorldY = params.m_chunkY * Region::Size;
+		const int64_t baseWorldX = params.m_regionCoordinate.x * Region::Size;
+		const int64_t baseWorldZ = params.m_regionCoordinate.z * Region::Size;
+		
+		for (int s = 0; s < 6; s++)
+		{
+			//Faces facing the bottom of the world are never visible.
+			const Region::Chunk* neighborChunk = GetNeighborChunk(params, s);
+			if (neighborChunk == nullptr ? s == BLOCK_SIDE_NEGY : neighborChunk->IsOpaque())
+				continue;
+			
+			const int axis = s / 2;
+			const int varyAxis1 = (axis + 1) % 3;
+			const int varyAxis2 = (axis + 2) % 3;
+			
+			glm::ivec3 localPos;
+			localPos[axis] = (s % 2 == 0) ? Region::Size - 1 : 0;
+			
+			for (int i = 0; i < Region::Size; i++)
+			{
+				localPos[varyAxis1] = i;
+				
+				for (int j = 0; j < Region::Size; j++)
+				{
+					localPos[varyAxis2] = j;
+					
+					if (IsFrontBlockOpaque(params, localPos, s))
+						continue;
+					
+					const glm::vec3 blockWorldCenter(baseWorldX + localPos.x + 0.5f, baseWorldY + localPos.y + 0.5f,
+					                                 baseWorldZ + localPos.z + 0.5f);
+					AddBlockFace(params, blockType, blockWorldCenter, s);
+				}
+			}
+		}
+	}
+	
 	void BuildChunkMesh(const ChunkMeshBuildParams& params)
 	{
-		const int64_t baseWorldY = params.m_chunkY * Region::Size;
+		const Region::Chunk& chunk = *params.m_chunk;
+		if (chunk.m_blocks.IsUniform())
+		{
+			const BlockType& blockType = BlockType::GetByID(chunk.m_blocks.GetUniformEntry().m_id);
+			
+			//Uniform chunks of blocks without geometry, such as air and water, don't need to be scanned.
+			if (!blockType.IsInitialized())
+				return;
+			
+			if (blockType.IsOpaque() && blockType.GetCustomMeshProvider() == nullptr)
+			{
+				BuildUniformOpaqueChunkMesh(params, blockType);
+				return;
+			}
+		}
+		
+		const int baseWorldY = params.m_chunkY * Region::Size;
+		
+		//Rows of the chunks above and below, used for the faces at the top and bottom of the chunk.
+		auto GetRowAbove = [&] (int z) { return params.m_chunkAbove ? params.m_chunkAbove->GetOpaqueRow(0, z) : 0U; };
+		auto GetRowBelow = [&] (int z)
+		{
+			return params.m_chunkBelow ? params.m_chunkBelow->GetOpaqueRow(Region::Size - 1, z) : ~0U;
+		};
 		
 		for (int yo = 0; yo < Region::Size; yo++)
 		{
-			const int64_t y = yo + baseWorldY;
+			const int y = yo + baseWorldY;
 			
 			for (int z = 0; z < Region::Size; z++)
 			{
-				const int64_t worldZ = z + params.m_region->GetZ() * Region::Size;
+				const int64_t worldZ = z + params.m_regionCoordinate.z * Region::Size;
+				
+				//Builds a mask for each side of the blocks in this row where the block in front of that side is opaque.
+				//Faces below the world are never visible, and faces above the world are always visible.
+				const uint32_t opaqueRow = chunk.GetOpaqueRow(yo, z);
+				uint32_t frontOpaque[6];
+				frontOpaque[BLOCK_SIDE_POSX] = (opaqueRow >> 1) |
+				                               (params.m_neighbors[NeighborPosX]->GetOpaqueRow(yo, z) << 31);
+				frontOpaque[BLOCK_SIDE_NEGX] = (opaqueRow << 1) |
+				                               (params.m_neighbors[NeighborNegX]->GetOpaqueRow(yo, z) >> 31);
+				frontOpaque[BLOCK_SIDE_POSY] = yo + 1 < Region::Size ? chunk.GetOpaqueRow(yo + 1, z) : GetRowAbove(z);
+				frontOpaque[BLOCK_SIDE_NEGY] = yo > 0 ? chunk.GetOpaqueRow(yo - 1, z) : GetRowBelow(z);
+				frontOpaque[BLOCK_SIDE_POSZ] = z + 1 < Region::Size ? chunk.GetOpaqueRow(yo, z + 1) :
+				                               params.m_neighbors[NeighborPosZ]->GetOpaqueRow(yo, 0);
+				frontOpaque[BLOCK_SIDE_NEGZ] = z > 0 ? chunk.GetOpaqueRow(yo, z - 1) :
+				                               params.m_neighbors[NeighborNegZ]->GetOpaqueRow(yo, Region::Size - 1);
+				
+				//Opaque blocks which are hidden on all sides don't contribute to the mesh and are skipped.
+				uint32_t hiddenRow = opaqueRow;
+				for (uint32_t frontOpaqueRow : frontOpaque)
+					hiddenRow &= frontOpaqueRow;
 				
-				for (int x = 0; x < Region::Size; x++)
+				for (uint32_t remaining = ~hiddenRow; remaining != 0; remaining &= remaining - 1)
 				{
-					const int64_t worldX = x + params.m_region->GetX() * Region::Size;
+					const int x = static_cast<int>(CountTrailingZeros(remaining));
+					const int64_t worldX = x + params.m_regionCoordinate.x * Region::Size;
 					
-					Region::BlockEntry block = params.m_region->Get(x, y, z);
+					const uint32_t blockIndex = static_cast<uint32_t>(x + (z + yo * Region::Size) * Region::Size);
+					Region::BlockEntry block = chunk.m_blocks.Get(blockIndex);
 					const BlockType& blockType = BlockType::GetByID(block.m_id);
 					
 					if (!blockType.IsInitialized())
@@ -37,69 +186,10 @@ namespace MCR
 					
 					for (int s = 0; s < 6; s++)
 					{
-						glm::ivec3 frontBlockPos = glm::ivec3(x, y, z) + BlockNormals[s];
-						
-						if (frontBlockPos.y < 0)
+						if ((frontOpaque[s] >> x) & 1U)
 							continue;
 						
-						const Region* frontRegion = params.m_region;
-						
-						//Modulates the front block position along the X-axis.
-						if (frontBlockPos.x < 0)
-						{
-							frontRegion = params.m_neighbors[NeighborNegX];
-							frontBlockPos.x += Region::Size;
-						}
-						else if (frontBlockPos.x >= Region::Size)
-						{
-							frontRegion = params.m_neighbors[NeighborPosX];
-							frontBlockPos.x -= Region::Size;
-						}
-						
-						//Modulates the front block position along the Z-axis.
-						if (frontBlockPos.z < 0)
-						{
-							frontRegion = params.m_neighbors[NeighborNegZ];
-							frontBlockPos.z += Region::Size;
-						}
-						else if (frontBlockPos.z >= Region::Size)
-						{
-							frontRegion = params.m_neighbors[NeighborPosZ];
-							frontBlockPos.z -= Region::Size;
-						}
-						
-						//Checks if the front block is opaque.
-						if (frontBlockPos.y < Region::Height)
-						{
-							uint8_t frontBlockID = frontRegion->Get(frontBlockPos.x, frontBlockPos.y, frontBlockPos.z).m_id;
-							const BlockType& frontBlockType = BlockType::GetByID(frontBlockID);
-							
-							if (frontBlockType.IsOpaque())
-								continue;
-						}
-						
-						const glm::vec3 faceCenter = blockWorldCenter + glm::vec3(BlockNormals[s]) * 0.5f;
-						
-						const int albedoLayer = blockType.GetAlbedoTextureLayer(s);
-						const int normalLayer = blockType.GetNormalTextureLayer(s);
-						
-						const uint32_t baseIndex = params.m_meshBuilder->GetNextVertexIndex();
-						params.m_meshBuilder->AddTriangle(baseIndex + 0, baseIndex + 1, baseIndex + 2);
-						params.m_meshBuilder->AddTriangle(baseIndex + 2, baseIndex + 1, baseIndex + 3);
-						
-						const glm::vec3 up = BlockTangents[s];
-						const glm::vec3 left = BlockBiTangents[s];
-						
-						for (int vx = 0; vx < 2; vx++)
-						{
-							for (int vy = 0; vy < 2; vy++)
-							{
-								const glm::vec3 pos = faceCenter + up * (vy - 0.5f) + left * (vx - 0.5f);
-								params.m_meshBuilder->AddVertex(pos, BlockNormals[s], left, { vx, 1 - vy },
-								                                albedoLayer, normalLayer, blockType.GetRoughness(),
-								                                blockType.GetBendiness());
-							}
-						}
+						AddBlockFace(params, blockType, blockWorldCenter, s);
 					}
 				}
 			}
@@ -110,12 +200,32 @@ namespace MCR
 	{
 		const int baseWorldY = chunkY * Region::Size;
 		
+		int firstLayer = 0;
+		
+		const ChunkStorage& chunk = region.GetChunk(chunkY);
+		if (chunk.IsUniform())
+		{
+			if (chunk.GetUniformEntry().m_id != BlockIDs::Water)
+				return;
+			
+			//Uniform water chunks can only have a water surface in the top layer, and only if the chunk above isn't
+			//also filled with water.
+			if (chunkY + 1 < Region::ChunkCount)
+			{
+				const ChunkStorage& chunkAbove = region.GetChunk(chunkY + 1);
+				if (chunkAbove.IsUniform() && chunkAbove.GetUniformEntry().m_id == BlockIDs::Water)
+					return;
+			}
+			
+			firstLayer = Region::Size - 1;
+		}
+		
 		std::array<int, Region::Size * Region::Size> lastOpaqueBlockYTable;
 		std::fill(MAKE_RANGE(lastOpaqueBlockYTable), -1);
 		
 		std::vector<glm::vec2> polygonVertices;
 		
-		for (int yo = 0; yo < Region::Size; yo++)
+		for (int yo = firstLayer; yo < Region::Size; yo++)
 		{
 			std::bitset<Region::Size * Region::Size> hasWater;
 			
@@ -123,21 +233,17 @@ namespace MCR
 			const int y = yo + baseWorldY;
 			for (int z = 0; z < Region::Size; z++)
 			{
-				const int64_t worldZ = z + region.GetZ() * Region::Size;
+				const uint32_t opaqueRow = region.GetOpaqueRow(y, z);
+				for (uint32_t remaining = opaqueRow; remaining != 0; remaining &= remaining - 1)
+				{
+					lastOpaqueBlockYTable[z * Region::Size + CountTrailingZeros(remaining)] = y;
+				}
 				
-				for (int x = 0; x < Region::Size; x++)
+				//If a block is water and the block above is air, insert a water quad.
+				for (uint32_t remaining = region.GetWaterRow(y, z) & ~opaqueRow; remaining != 0; remaining &= remaining - 1)
 				{
-					const int64_t worldX = x + region.GetX() * Region::Size;
-					
-					Region::BlockEntry block = region.Get(x, y, z);
-					
-					if (BlockType::GetByID(block.m_id).IsOpaque())
-					{
-						lastOpaqueBlockYTable[z * Region::Size + x] = y;
-					}
-					//If this block is water and the block above is air, insert a water quad.
-					else if (block.m_id == BlockIDs::Water &&
-					         (y == Region::Height - 1 || region.Get(x, y + 1, z).m_id == BlockIDs::Air))
+					const int x = static_cast<int>(CountTrailingZeros(remaining));
+					if (y == Region::Height - 1 || region.Get(x, y + 1, z).m_id == BlockIDs::Air)
 					{
 						hasWater.set(static_cast<size_t>(z * Region::Size + x));
 					}
@@ -155,12 +261,18 @@ namespace MCR
 				
 				if (lastOpaqueBlockY == -1)
 				{
-					lastOpaqueBlockY = baseWorldY - 1;
-					while (lastOpaqueBlockY > 0 &&
-					       !BlockType::GetByID(region.Get(x, lastOpaqueBlockY, z).m_id).IsOpaque())
+					//The height map gives the answer directly unless there are opaque blocks above this chunk.
+					lastOpaqueBlockY = region.GetMaxSolidY(static_cast<int>(x), static_cast<int>(z));
+					if (lastOpaqueBlockY >= baseWorldY)
 					{
-						lastOpaqueBlockY--;
+						lastOpaqueBlockY = baseWorldY - 1;
+						while (lastOpaqueBlockY > 0 &&
+						       !region.IsBlockOpaque(static_cast<int>(x), lastOpaqueBlockY, static_cast<int>(z)))
+						{
+							lastOpaqueBlockY--;
+						}
 					}
+					lastOpaqueBlockY = std::max(lastOpaqueBlockY, 0);
 				}
 				
 				return lastOpaqueBlockY;
@@ -15,10 +15,15 @@ namespace MCR
 		NeighborNegZ,
 	};
 	
+	//Meshes are built from chunk snapshots rather than regions, so that the build thread never reads a chunk which
+	//is being modified.
 	struct ChunkMeshBuildParams
 	{
-		const Region* m_region;
-		const Region* m_neighbors[4]; //Indexed using RegionNeighbors
+		const Region::Chunk* m_chunk;
+		const Region::Chunk* m_chunkAbove; //Null for the top chunk of a region
+		const Region::Chunk* m_chunkBelow; //Null for the bottom chunk of a region
+		const Region::Chunk* m_neighbors[4]; //At the same height in neighboring regions, indexed using RegionNeighbors
+		RegionCoordinate m_regionCoordinate;
 		uint32_t m_chunkY;
 		MeshBuilder* m_meshBuilder;
 	};
@@ -27,8 +27,8 @@ namespace MCR
 		
 	}
 	
-	void ChunkUploader::BeginUploading(int64_t x, int64_t y, int64_t z, Region::ChunkConnectivity connectivity,
-	                                   const MeshBuilder& meshBuilder)
+	void ChunkUploader::BeginUploading(int64_t x, int64_t y, int64_t z, uint64_t version,
+	                                   Region::ChunkConnectivity connectivity, const MeshBuilder& meshBuilder)
 	{
 		std::lock_guard<std::mutex> lock(m_mutex);
 		
@@ -51,7 +51,7 @@ namespace MCR
 		transferSubmitInfo.pCommandBuffers = &commandBuffer.GetVkCB();
 		vulkan.queues[QUEUE_FAMILY_TRANSFER]->Submit(1, &transferSubmitInfo, *hostBuffer.m_fence);
 		
-		m_tasks.push_back({ x, y, z, std::move(chunk), std::move(hostBuffer), std::move(commandBuffer) });
+		m_tasks.push_back({ x, y, z, version, std::move(chunk), std::move(hostBuffer), std::move(commandBuffer) });
 	}
 	
 	void ChunkUploader::WaitIdle()
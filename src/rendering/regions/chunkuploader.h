@@ -12,12 +12,13 @@ namespace MCR
 	public:
 		ChunkUploader();
 		
-		void BeginUploading(int64_t x, int64_t y, int64_t z, Region::ChunkConnectivity connectivity,
+		//version identifies the chunk data the mesh was built from, and is passed back through IterateCompleted.
+		void BeginUploading(int64_t x, int64_t y, int64_t z, uint64_t version, Region::ChunkConnectivity connectivity,
 		                    const class MeshBuilder& meshBuilder);
 		
 		void WaitIdle();
 		
-		//Signature for CallbackTp: (int64_t x, int64_t y, int64_t z, ChunkMesh& mesh)
+		//Signature for CallbackTp: (int64_t x, int64_t y, int64_t z, uint64_t version, ChunkMesh& mesh)
 		template <typename CallbackTp>
 		void IterateCompleted(CallbackTp callback)
 		{
@@ -27,7 +28,8 @@ namespace MCR
 			{
 				if (vkGetFenceStatus(vulkan.device, *m_tasks[i].m_hostBuffer.m_fence) == VK_SUCCESS)
 				{
-					callback(m_tasks[i].m_x, m_tasks[i].m_y, m_tasks[i].m_z, m_tasks[i].m_chunk);
+					Task& task = m_tasks[i];
+					callback(task.m_x, task.m_y, task.m_z, task.m_version, task.m_chunk);
 					
 					m_hostBuffers.push_back(std::move(m_tasks[i].m_hostBuffer));
 					
@@ -65,6 +67,7 @@ namespace MCR
 			int64_t m_x;
 			int64_t m_y;
 			int64_t m_z;
+			uint64_t m_version;
 			ChunkMesh m_chunk;
 			HostBuffer m_hostBuffer;
 			CommandBuffer m_cb;
@@ -199,6 +199,8 @@ namespace MCR
 			{
 				m_worldManager->FillRenderList(m_chunkRenderList, m_frustum);
 			}
+			
+			m_worldManager->UpdateMissingMeshStats(m_frustum);
 		}
 		
 		{
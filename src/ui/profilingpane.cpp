@@ -131,6 +131,11 @@ namespace MCR
 		std::ostringstream topTextStream;
 		topTextStream << "Frame Time: " << profilingData.GetFrameTime().count() << "ms\n";
 		topTextStream << "FPS: " << (1000.0f / profilingData.GetFrameTime().count()) << "Hz";
+		std::for_each(profilingData.CountersBegin(), profilingData.CountersEnd(),
+		              [&] (const ProfilingData::Counter& counter)
+		{
+			topTextStream << "\n" << counter.m_name << ": " << counter.m_value;
+		});
 		const std::string topText = topTextStream.str();
 		
 		pos.y += m_contentsList.AddText(Font::GetStandardDev(), topText, pos + glm::vec2(5.0f), glm::vec4(1.0f),
@@ -69,9 +69,9 @@ namespace MCR
 			m_velocity *= MaxSpeed / speed;
 		}
 		
-		float moveSpeed = inputState.IsKeyPressed(Keys::Q) ? 3.0f : 1.0f;
+		m_speedMultiplier = inputState.IsKeyPressed(Keys::Q) ? 3.0f : 1.0f;
 		
-		m_position += (m_velocity + oldVelocity) * 0.5f * dt * moveSpeed;
+		m_position += (m_velocity + oldVelocity) * 0.5f * dt * m_speedMultiplier;
 		
 		m_viewMatrix = glm::scale(glm::mat4(), glm::vec3(1, -1, 1)) *
 		               m_invRotationMatrix *
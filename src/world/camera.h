@@ -31,6 +31,12 @@ namespace MCR
 			return glm::vec3(m_rotationMatrix[1]);
 		}
 		
+		//The velocity the camera is moving at, including the speed multiplier.
+		inline glm::vec3 GetVelocity() const
+		{
+			return m_velocity * m_speedMultiplier;
+		}
+		
 		inline const glm::mat4& GetViewMatrix() const
 		{
 			return m_viewMatrix;
@@ -46,6 +52,7 @@ namespace MCR
 		glm::vec2 m_rotation;
 		
 		glm::vec3 m_velocity;
+		float m_speedMultiplier = 1.0f;
 		
 		glm::mat4 m_invRotationMatrix;
 		glm::mat4 m_rotationMatrix;
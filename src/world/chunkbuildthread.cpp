@@ -17,14 +17,19 @@ namespace MCR
 		m_uploader.WaitIdle();
 	}
 	
-	void ChunkBuildThread::BuildSync(const Region& region, uint32_t chunkY, gsl::span<const Region*> neighbors,
-	                                 MeshBuilder& meshBuilder)
+	void ChunkBuildThread::BuildSync(const BuildCommand& buildCommand, MeshBuilder& meshBuilder)
 	{
 		ChunkMeshBuildParams buildParams;
 		buildParams.m_meshBuilder = &meshBuilder;
-		buildParams.m_region = &region;
-		buildParams.m_chunkY = chunkY;
-		std::copy_n(neighbors.begin(), 4, buildParams.m_neighbors);
+		buildParams.m_chunk = buildCommand.m_chunk.get();
+		buildParams.m_chunkAbove = buildCommand.m_chunkAbove.get();
+		buildParams.m_chunkBelow = buildCommand.m_chunkBelow.get();
+		buildParams.m_regionCoordinate = buildCommand.m_coordinate;
+		buildParams.m_chunkY = buildCommand.m_chunkY;
+		for (int i = 0; i < 4; i++)
+		{
+			buildParams.m_neighbors[i] = buildCommand.m_neighbors[i].get();
+		}
 		
 		meshBuilder.Reset();
 		
@@ -32,9 +37,10 @@ namespace MCR
 		
 		if (!meshBuilder.Empty())
 		{
-			const Region::ChunkConnectivity connectivity = region.CalculateConnectivity(chunkY);
+			const Region::ChunkConnectivity connectivity = Region::CalculateConnectivity(*buildCommand.m_chunk);
 			
-			m_uploader.BeginUploading(region.GetX(), chunkY, region.GetZ(), connectivity, meshBuilder);
+			m_uploader.BeginUploading(buildCommand.m_coordinate.x, buildCommand.m_chunkY, buildCommand.m_coordinate.z,
+			                          buildCommand.m_version, connectivity, meshBuilder);
 		}
 	}
 	
@@ -77,29 +83,7 @@ namespace MCR
 			
 			lock.unlock();
 			
-			std::shared_ptr<const Region> region = buildCommand.m_region.lock();
-			if (region == nullptr)
-				continue;
-			
-			std::array<std::shared_ptr<const Region>, 4> neighborRegionsSP;
-			std::array<const Region*, 4> neighborRegionsP;
-			
-			bool anyNeighborNull = false;
-			for (int i = 0; i < 4; i++)
-			{
-				neighborRegionsSP[i] = buildCommand.m_neighbors[i].lock();
-				neighborRegionsP[i] = neighborRegionsSP[i].get();
-				if (neighborRegionsP[i] == nullptr)
-				{
-					anyNeighborNull = true;
-					break;
-				}
-			}
-			
-			if (!anyNeighborNull)
-			{
-				BuildSync(*region, buildCommand.m_chunkY, neighborRegionsP, m_meshBuilder);
-			}
+			BuildSync(buildCommand, m_meshBuilder);
 		}
 	}
 }
@@ -15,12 +15,17 @@ namespace MCR
 	class ChunkBuildThread final
 	{
 	public:
+		//Holds snapshots of the chunk to build and the chunks around it, so building never races with modifications
+		//to the regions. m_version is the highest version of these chunks, and is passed back with the built mesh.
 		struct BuildCommand
 		{
 			RegionCoordinate m_coordinate;
 			uint32_t m_chunkY;
-			std::weak_ptr<const Region> m_region;
-			std::weak_ptr<const Region> m_neighbors[4];
+			uint64_t m_version;
+			std::shared_ptr<const Region::Chunk> m_chunk;
+			std::shared_ptr<const Region::Chunk> m_chunkAbove;
+			std::shared_ptr<const Region::Chunk> m_chunkBelow;
+			std::shared_ptr<const Region::Chunk> m_neighbors[4];
 		};
 		
 		inline ChunkBuildThread()
@@ -35,9 +40,9 @@ namespace MCR
 		}
 		
 		//Only call between BeginUpdating and EndUpdating.
-		inline void BuildASync(const BuildCommand& buildCommand)
+		inline void BuildASync(BuildCommand buildCommand)
 		{
-			m_buildCommands.push_back(buildCommand);
+			m_buildCommands.push_back(std::move(buildCommand));
 			m_anyCommandsEnqueued = true;
 		}
 		
@@ -58,8 +63,7 @@ namespace MCR
 			m_mutex.unlock();
 		}
 		
-		void BuildSync(const Region& region, uint32_t chunkY, gsl::span<const Region*> neighbors,
-		               MeshBuilder& meshBuilder);
+		void BuildSync(const BuildCommand& buildCommand, MeshBuilder& meshBuilder);
 		
 		template <typename CallbackTp>
 		inline void IterateCompleted(CallbackTp callback)
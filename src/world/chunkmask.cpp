@@ -0,0 +1,89 @@
+#include "chunkmask.h"
+
+#include <algorithm>
+#include <array>
+
+namespace MCR
+{
+	constexpr int ChunkMask::Size;
+	constexpr int ChunkMask::RowCount;
+	
+	static std::array<uint32_t, ChunkMask::RowCount> MakeUniformRows(uint32_t row)
+	{
+		std::array<uint32_t, ChunkMask::RowCount> rows;
+		rows.fill(row);
+		return rows;
+	}
+	
+	static const std::array<uint32_t, ChunkMask::RowCount> clearRows = { };
+	static const std::array<uint32_t, ChunkMask::RowCount> setRows = MakeUniformRows(~0U);
+	
+	ChunkMask::ChunkMask()
+	    : m_rows(clearRows.data()) { }
+	
+	ChunkMask::ChunkMask(const ChunkMask& other)
+	    : m_rows(other.m_rows)
+	{
+		if (other.m_ownedRows)
+		{
+			m_ownedRows.reset(new uint32_t[RowCount]);
+			std::copy(other.m_rows, other.m_rows + RowCount, m_ownedRows.get());
+			m_rows = m_ownedRows.get();
+		}
+	}
+	
+	void ChunkMask::Set(int x, int y, int z, bool value)
+	{
+		const int rowIndex = z + y * Size;
+		const uint32_t bit = 1U << x;
+		
+		if (((m_rows[rowIndex] & bit) != 0) == value)
+			return;
+		
+		if (!m_ownedRows)
+		{
+			m_ownedRows.reset(new uint32_t[RowCount]);
+			std::copy(m_rows, m_rows + RowCount, m_ownedRows.get());
+			m_rows = m_ownedRows.get();
+		}
+		
+		m_ownedRows[rowIndex] ^= bit;
+	}
+	
+	void ChunkMask::Fill(bool value)
+	{
+		m_ownedRows.reset();
+		m_rows = value ? setRows.data() : clearRows.data();
+	}
+	
+	void ChunkMask::Clear()
+	{
+		if (m_ownedRows)
+		{
+			std::fill(m_ownedRows.get(), m_ownedRows.get() + RowCount, 0U);
+		}
+		else
+		{
+			m_rows = clearRows.data();
+		}
+	}
+	
+	void ChunkMask::Assign(const uint32_t* rows)
+	{
+		//Masks where all bits are equal use the shared rows instead.
+		const uint32_t first = rows[0];
+		if ((first == 0 || first == ~0U) && std::all_of(rows, rows + RowCount, [&] (uint32_t row) { return row == first; }))
+		{
+			Fill(first != 0);
+			return;
+		}
+		
+		if (!m_ownedRows)
+		{
+			m_ownedRows.reset(new uint32_t[RowCount]);
+			m_rows = m_ownedRows.get();
+		}
+		
+		std::copy(rows, rows + RowCount, m_ownedRows.get());
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace MCR
+{
+	//Returns the index of the lowest set bit, value must not be zero.
+	inline uint32_t CountTrailingZeros(uint32_t value)
+	{
+#if defined(__GNUC__)
+		return static_cast<uint32_t>(__builtin_ctz(value));
+#elif defined(_MSC_VER)
+		unsigned long trailingZero;
+		_BitScanForward(&trailingZero, value);
+		return trailingZero;
+#else
+#
+		"Unknown compiler"
+#endif
+	}
+	
+	inline int PopCount(uint32_t value)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcount(value);
+#elif defined(_MSC_VER)
+		return static_cast<int>(__popcnt(value));
+#else
+#
+		"Unknown compiler"
+#endif
+	}
+	
+	//Stores one bit per block in a chunk, as one 32-bit word for each row of blocks along the X-axis. Bit x of the row
+	//at (y, z) corresponds to the block at (x, y, z). Masks where all bits are equal point to a shared row array
+	//instead of allocating their own, the rows are only allocated once a single bit is changed.
+	class ChunkMask
+	{
+	public:
+		ChunkMask();
+		
+		//Copies share the rows of uniform masks, but allocate their own rows otherwise.
+		ChunkMask(const ChunkMask& other);
+		ChunkMask(ChunkMask&& other) = default;
+		
+		inline uint32_t GetRow(int y, int z) const
+		{
+			return m_rows[z + y * Size];
+		}
+		
+		inline bool Get(int x, int y, int z) const
+		{
+			return (GetRow(y, z) >> x) & 1U;
+		}
+		
+		void Set(int x, int y, int z, bool value);
+		
+		//Sets or clears all bits and releases the allocated rows.
+		void Fill(bool value);
+		
+		//Clears all bits, but keeps the allocated rows (if any) for reuse.
+		void Clear();
+		
+		//Replaces the contents of the mask with RowCount rows.
+		void Assign(const uint32_t* rows);
+		
+		//Returns the number of heap bytes used by this mask.
+		inline size_t GetMemoryUsage() const
+		{
+			return m_ownedRows ? RowCount * sizeof(uint32_t) : 0;
+		}
+		
+		static constexpr int Size = 32;
+		static constexpr int RowCount = Size * Size;
+		
+	private:
+		const uint32_t* m_rows;
+		std::unique_ptr<uint32_t[]> m_ownedRows;
+	};
+}
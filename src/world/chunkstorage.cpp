@@ -0,0 +1,170 @@
+#include "chunkstorage.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace MCR
+{
+	constexpr uint32_t ChunkStorage::Size;
+	constexpr uint32_t ChunkStorage::BlockCount;
+	
+	ChunkStorage::ChunkStorage()
+	    : m_palette(1), m_bitsPerBlock(0), m_indexMask(0), m_words(GetNumWords(0), 0) { }
+	
+	uint32_t ChunkStorage::GetBitsForPaletteSize(size_t paletteSize)
+	{
+		if (paletteSize <= 1)
+			return 0;
+		if (paletteSize <= 2)
+			return 1;
+		if (paletteSize <= 4)
+			return 2;
+		if (paletteSize <= 16)
+			return 4;
+		if (paletteSize <= 256)
+			return 8;
+		return 16;
+	}
+	
+	void ChunkStorage::Repack(uint32_t bitsPerBlock, const uint32_t* remap)
+	{
+		//Copies the old indices out so that the existing word buffer can be reused for the new indices.
+		const std::vector<uint64_t> oldWords(m_words.begin(), m_words.begin() + GetNumWords(m_bitsPerBlock));
+		m_words.assign(GetNumWords(bitsPerBlock), 0);
+		
+		const uint32_t oldBitsPerBlock = m_bitsPerBlock;
+		const uint32_t oldIndexMask = m_indexMask;
+		
+		m_bitsPerBlock = bitsPerBlock;
+		m_indexMask = (1U << bitsPerBlock) - 1;
+		
+		for (uint32_t i = 0; i < BlockCount; i++)
+		{
+			const uint32_t oldBitIndex = i * oldBitsPerBlock;
+			uint32_t paletteIndex = static_cast<uint32_t>(oldWords[oldBitIndex / 64] >> (oldBitIndex % 64)) & oldIndexMask;
+			
+			if (remap != nullptr)
+			{
+				paletteIndex = remap[paletteIndex];
+			}
+			
+			SetPaletteIndex(i, paletteIndex);
+		}
+	}
+	
+	uint32_t ChunkStorage::GetOrAddPaletteIndex(BlockEntry entry)
+	{
+		auto it = std::find(m_palette.begin(), m_palette.end(), entry);
+		if (it != m_palette.end())
+			return static_cast<uint32_t>(it - m_palette.begin());
+		
+		m_palette.push_back(entry);
+		
+		//Widens the indices if the new palette entry can't be addressed with the current number of bits.
+		const uint32_t requiredBits = GetBitsForPaletteSize(m_palette.size());
+		if (requiredBits != m_bitsPerBlock)
+		{
+			Repack(requiredBits, nullptr);
+		}
+		
+		return static_cast<uint32_t>(m_palette.size() - 1);
+	}
+	
+	BlockEntry ChunkStorage::Set(uint32_t index, BlockEntry entry)
+	{
+		const BlockEntry oldEntry = Get(index);
+		if (oldEntry != entry)
+		{
+			SetPaletteIndex(index, GetOrAddPaletteIndex(entry));
+		}
+		return oldEntry;
+	}
+	
+	void ChunkStorage::Fill(BlockEntry entry)
+	{
+		m_palette.assign(1, entry);
+		m_palette.shrink_to_fit();
+		m_bitsPerBlock = 0;
+		m_indexMask = 0;
+		m_words.assign(GetNumWords(0), 0);
+		m_words.shrink_to_fit();
+	}
+	
+	void ChunkStorage::Clear()
+	{
+		m_palette.assign(1, BlockEntry());
+		m_bitsPerBlock = 0;
+		m_indexMask = 0;
+		m_words[0] = 0;
+	}
+	
+	void ChunkStorage::Compact()
+	{
+		if (IsUniform())
+			return;
+		
+		constexpr uint32_t unused = std::numeric_limits<uint32_t>::max();
+		
+		std::vector<uint32_t> remap(m_palette.size(), unused);
+		std::vector<BlockEntry> newPalette;
+		
+		for (uint32_t i = 0; i < BlockCount; i++)
+		{
+			uint32_t& newIndex = remap[GetPaletteIndex(i)];
+			if (newIndex == unused)
+			{
+				newIndex = static_cast<uint32_t>(newPalette.size());
+				newPalette.push_back(m_palette[GetPaletteIndex(i)]);
+			}
+		}
+		
+		if (newPalette.size() == m_palette.size())
+			return;
+		
+		Repack(GetBitsForPaletteSize(newPalette.size()), remap.data());
+		m_palette = std::move(newPalette);
+		m_palette.shrink_to_fit();
+		m_words.shrink_to_fit();
+	}
+	
+	void ChunkStorage::Read(const BlockEntry* blocks)
+	{
+		Fill(blocks[0]);
+		
+		for (uint32_t i = 1; i < BlockCount; i++)
+		{
+			if (blocks[i] != blocks[0])
+			{
+				SetPaletteIndex(i, GetOrAddPaletteIndex(blocks[i]));
+			}
+		}
+	}
+	
+	void ChunkStorage::Write(BlockEntry* blocks) const
+	{
+		for (uint32_t i = 0; i < BlockCount; i++)
+		{
+			blocks[i] = Get(i);
+		}
+	}
+	
+	bool ChunkStorage::OnlyContains(BlockEntry entry) const
+	{
+		if (IsUniform())
+			return m_palette[0] == entry;
+		if (std::find(m_palette.begin(), m_palette.end(), entry) == m_palette.end())
+			return false;
+		
+		for (uint32_t i = 0; i < BlockCount; i++)
+		{
+			if (Get(i) != entry)
+				return false;
+		}
+		return true;
+	}
+	
+	size_t ChunkStorage::GetMemoryUsage() const
+	{
+		return m_palette.capacity() * sizeof(BlockEntry) + m_words.capacity() * sizeof(uint64_t);
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+namespace MCR
+{
+#pragma pack(push, 1)
+	struct BlockEntry
+	{
+		uint8_t m_id = 0;
+		uint8_t m_data = 0;
+	};
+#pragma pack(pop)
+	
+	inline bool operator==(BlockEntry a, BlockEntry b)
+	{
+		return a.m_id == b.m_id && a.m_data == b.m_data;
+	}
+	
+	inline bool operator!=(BlockEntry a, BlockEntry b)
+	{
+		return a.m_id != b.m_id || a.m_data != b.m_data;
+	}
+	
+	//Stores the blocks of a single chunk as indices into a palette of the block entries used by the chunk.
+	//The indices are bit packed into 64-bit words using 1, 2, 4, 8 or 16 bits per block, depending on the size of
+	//the palette. Entries are never removed from the palette by Set, call Compact to drop unused entries.
+	//Chunks with a single palette entry are uniform, they use zero bits per block and store no indices.
+	class ChunkStorage
+	{
+	public:
+		ChunkStorage();
+		
+		inline BlockEntry Get(uint32_t index) const
+		{
+			return m_palette[GetPaletteIndex(index)];
+		}
+		
+		//Sets the block at the given index and returns the entry that was previously stored there.
+		BlockEntry Set(uint32_t index, BlockEntry entry);
+		
+		//Replaces the contents of the chunk with a single entry, making the chunk uniform.
+		void Fill(BlockEntry entry);
+		
+		//Fills the chunk with air like Fill, but keeps the allocated palette and index buffers for reuse.
+		void Clear();
+		
+		//Rebuilds the palette so that it only contains entries which are in use, and shrinks the index width to match.
+		void Compact();
+		
+		//Replaces the contents of the chunk with BlockCount densely stored entries.
+		void Read(const BlockEntry* blocks);
+		
+		//Writes the contents of the chunk as BlockCount densely stored entries.
+		void Write(BlockEntry* blocks) const;
+		
+		bool OnlyContains(BlockEntry entry) const;
+		
+		inline bool IsUniform() const
+		{
+			return m_bitsPerBlock == 0;
+		}
+		
+		//Only valid if the chunk is uniform.
+		inline BlockEntry GetUniformEntry() const
+		{
+			return m_palette[0];
+		}
+		
+		inline uint32_t GetBitsPerBlock() const
+		{
+			return m_bitsPerBlock;
+		}
+		
+		inline size_t GetPaletteSize() const
+		{
+			return m_palette.size();
+		}
+		
+		inline const std::vector<BlockEntry>& GetPalette() const
+		{
+			return m_palette;
+		}
+		
+		//Returns the index into the palette of the block at the given index.
+		//For uniform chunks both the bit index and the index mask are zero, so this reads the single padding word.
+		inline uint32_t GetPaletteIndex(uint32_t index) const
+		{
+			const uint32_t bitIndex = index * m_bitsPerBlock;
+			return static_cast<uint32_t>(m_words[bitIndex / 64] >> (bitIndex % 64)) & m_indexMask;
+		}
+		
+		//Returns the number of heap bytes used by this chunk.
+		size_t GetMemoryUsage() const;
+		
+		static constexpr uint32_t Size = 32;
+		static constexpr uint32_t BlockCount = Size * Size * Size;
+		
+	private:
+		inline void SetPaletteIndex(uint32_t index, uint32_t paletteIndex)
+		{
+			const uint32_t bitIndex = index * m_bitsPerBlock;
+			uint64_t& word = m_words[bitIndex / 64];
+			word &= ~(static_cast<uint64_t>(m_indexMask) << (bitIndex % 64));
+			word |= static_cast<uint64_t>(paletteIndex) << (bitIndex % 64);
+		}
+		
+		uint32_t GetOrAddPaletteIndex(BlockEntry entry);
+		
+		//Changes the number of bits used per block, repacking existing indices using the given remap table (if any).
+		void Repack(uint32_t bitsPerBlock, const uint32_t* remap);
+		
+		static uint32_t GetBitsForPaletteSize(size_t paletteSize);
+		
+		static inline size_t GetNumWords(uint32_t bitsPerBlock)
+		{
+			return std::max<size_t>(BlockCount * bitsPerBlock / 64, 1);
+		}
+		
+		std::vector<BlockEntry> m_palette;
+		
+		uint32_t m_bitsPerBlock;
+		uint32_t m_indexMask;
+		std::vector<uint64_t> m_words;
+	};
+}
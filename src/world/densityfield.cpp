@@ -0,0 +1,82 @@
+#include "densityfield.h"
+
+namespace MCR
+{
+	DensityField::DensityField(const PerlinNoise& noise, double scale, bool coarse)
+	    : m_noise(noise), m_scale(scale), m_coarse(coarse) { }
+	
+	void DensityField::SetRegion(int64_t regionX, int64_t regionZ, int maxY)
+	{
+		m_minX = regionX * Region::Size;
+		m_minZ = regionZ * Region::Size;
+		m_maxY = maxY;
+		
+		if (!m_coarse)
+		{
+			for (int y = 0; y <= maxY; y++)
+			{
+				m_blockYs[y] = y / m_scale;
+			}
+			return;
+		}
+		
+		//Enough lattice points for the cell above maxY to be interpolated.
+		m_latticeHeight = maxY / CellHeight + 2;
+		m_lattice.resize(static_cast<size_t>(LatticeWidth * LatticeWidth * m_latticeHeight));
+		
+		std::array<double, MaxLatticeHeight> latticeYs;
+		for (int y = 0; y < m_latticeHeight; y++)
+		{
+			latticeYs[y] = (y * CellHeight) / m_scale;
+		}
+		
+		for (int z = 0; z < LatticeWidth; z++)
+		{
+			const double pz = (m_minZ + z * CellWidth) / m_scale;
+			
+			for (int x = 0; x < LatticeWidth; x++)
+			{
+				const double px = (m_minX + x * CellWidth) / m_scale;
+				m_noise.FillColumn(px, pz, latticeYs.data(), m_latticeHeight, &m_lattice[GetLatticeIndex(x, z)]);
+			}
+		}
+	}
+	
+	void DensityField::GetColumn(int lx, int lz, double* values) const
+	{
+		if (!m_coarse)
+		{
+			const double px = (m_minX + lx) / m_scale;
+			const double pz = (m_minZ + lz) / m_scale;
+			
+			m_noise.FillColumn(px, pz, m_blockYs.data(), m_maxY + 1, values);
+			return;
+		}
+		
+		const int cellX = lx / CellWidth;
+		const int cellZ = lz / CellWidth;
+		const double tx = (lx % CellWidth) / static_cast<double>(CellWidth);
+		const double tz = (lz % CellWidth) / static_cast<double>(CellWidth);
+		
+		const double* column00 = &m_lattice[GetLatticeIndex(cellX, cellZ)];
+		const double* column10 = &m_lattice[GetLatticeIndex(cellX + 1, cellZ)];
+		const double* column01 = &m_lattice[GetLatticeIndex(cellX, cellZ + 1)];
+		const double* column11 = &m_lattice[GetLatticeIndex(cellX + 1, cellZ + 1)];
+		
+		//Interpolates horizontally once per lattice point, then vertically for each block.
+		std::array<double, MaxLatticeHeight> latticeColumn;
+		for (int y = 0; y < m_latticeHeight; y++)
+		{
+			const double value0 = column00[y] + (column10[y] - column00[y]) * tx;
+			const double value1 = column01[y] + (column11[y] - column01[y]) * tx;
+			latticeColumn[y] = value0 + (value1 - value0) * tz;
+		}
+		
+		for (int y = 0; y <= m_maxY; y++)
+		{
+			const int cellY = y / CellHeight;
+			const double ty = (y % CellHeight) / static_cast<double>(CellHeight);
+			values[y] = latticeColumn[cellY] + (latticeColumn[cellY + 1] - latticeColumn[cellY]) * ty;
+		}
+	}
+}
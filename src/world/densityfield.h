@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+
+#include "region.h"
+#include "perlinnoise.h"
+
+namespace MCR
+{
+	//Samples a 3D noise over the columns of a region, either exactly at every block or on a coarse lattice with the
+	//values in between trilinearly interpolated, which needs about a hundredth of the noise evaluations. The lattice
+	//is aligned to world coordinates, so interpolated values match across region borders. Columns are evaluated in
+	//batches through PerlinNoise::FillColumn.
+	class DensityField
+	{
+	public:
+		//The spacing between lattice points, in blocks.
+		static constexpr int CellWidth = 4;
+		static constexpr int CellHeight = 8;
+		
+		//The noise is evaluated at world coordinates divided by scale.
+		DensityField(const PerlinNoise& noise, double scale, bool coarse);
+		
+		//Prepares sampling of a region's columns from y = 0 to maxY, which evaluates the lattice in coarse mode.
+		void SetRegion(int64_t regionX, int64_t regionZ, int maxY);
+		
+		//Writes the values from y = 0 to maxY of a column in the region to values.
+		void GetColumn(int lx, int lz, double* values) const;
+		
+		inline bool IsCoarse() const
+		{
+			return m_coarse;
+		}
+		
+	private:
+		static constexpr int LatticeWidth = Region::Size / CellWidth + 1;
+		static constexpr int MaxLatticeHeight = Region::Height / CellHeight + 2;
+		
+		static_assert(Region::Size % CellWidth == 0, "Regions must contain whole lattice cells.");
+		
+		inline size_t GetLatticeIndex(int x, int z) const
+		{
+			return static_cast<size_t>(z * LatticeWidth + x) * m_latticeHeight;
+		}
+		
+		const PerlinNoise& m_noise;
+		double m_scale;
+		bool m_coarse;
+		
+		int64_t m_minX = 0;
+		int64_t m_minZ = 0;
+		int m_maxY = 0;
+		
+		//The noise y coordinate of each block in exact mode.
+		std::array<double, Region::Height> m_blockYs;
+		
+		//Lattice values, each lattice column stores m_latticeHeight values from bottom to top.
+		int m_latticeHeight = 0;
+		std::vector<double> m_lattice;
+	};
+}
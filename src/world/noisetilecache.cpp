@@ -0,0 +1,84 @@
+#include "noisetilecache.h"
+
+namespace MCR
+{
+	NoiseTileCache::NoiseTileCache(size_t capacityTiles)
+	    : m_capacity(capacityTiles) { }
+	
+	std::shared_ptr<const NoiseTileCache::Tile> NoiseTileCache::Get(RegionCoordinate coordinate, uint32_t noiseID,
+	                                                                const std::function<void(Tile&)>& fill)
+	{
+		//Without a capacity, tiles are filled without locking, since nothing is shared.
+		if (m_capacity.load(std::memory_order_relaxed) == 0)
+		{
+			auto tile = std::make_shared<Tile>();
+			fill(*tile);
+			return tile;
+		}
+		
+		const TileKey key = { coordinate, noiseID };
+		
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			
+			auto entryIt = m_entryMap.find(key);
+			if (entryIt != m_entryMap.end())
+			{
+				m_hits++;
+				m_entries.splice(m_entries.begin(), m_entries, entryIt->second);
+				return entryIt->second->m_tile;
+			}
+		}
+		
+		m_misses++;
+		
+		//The tile is filled without holding the mutex, so that other threads can use the cache in the meantime.
+		auto tile = std::make_shared<Tile>();
+		fill(*tile);
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		if (m_capacity.load(std::memory_order_relaxed) == 0)
+			return tile;
+		
+		//Another thread may have filled the same tile while the mutex wasn't held.
+		auto entryIt = m_entryMap.find(key);
+		if (entryIt != m_entryMap.end())
+		{
+			m_entries.splice(m_entries.begin(), m_entries, entryIt->second);
+			return entryIt->second->m_tile;
+		}
+		
+		m_entries.push_front({ key, tile });
+		m_entryMap.emplace(key, m_entries.begin());
+		
+		Evict();
+		
+		return tile;
+	}
+	
+	void NoiseTileCache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		m_entries.clear();
+		m_entryMap.clear();
+	}
+	
+	void NoiseTileCache::SetCapacity(size_t capacityTiles)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		m_capacity = capacityTiles;
+		Evict();
+	}
+	
+	void NoiseTileCache::Evict()
+	{
+		while (m_entries.size() > m_capacity)
+		{
+			m_entryMap.erase(m_entries.back().m_key);
+			m_entries.pop_back();
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+#include "region.h"
+
+namespace MCR
+{
+	//Keeps the values of 2D noises over whole regions, so that a region which is generated again (for example after
+	//leaving the loaded area while region IO is disabled) doesn't have to evaluate them again. Tiles are shared by
+	//all threads generating regions, and the least recently used tiles are dropped once more than the capacity are
+	//cached. All functions are thread safe.
+	class NoiseTileCache
+	{
+	public:
+		//Noise values indexed by lz * Region::Size + lx.
+		using Tile = std::array<double, Region::Size * Region::Size>;
+		
+		explicit NoiseTileCache(size_t capacityTiles = 0);
+		
+		//Returns the tile of noise noiseID for a region, calling fill to compute it if it isn't cached. The returned
+		//tile stays valid after being evicted.
+		std::shared_ptr<const Tile> Get(RegionCoordinate coordinate, uint32_t noiseID,
+		                                const std::function<void(Tile&)>& fill);
+		
+		void Clear();
+		
+		//Sets the maximum number of tiles to keep, a capacity of 0 disables the cache.
+		void SetCapacity(size_t capacityTiles);
+		
+		inline size_t GetCapacity() const
+		{
+			return m_capacity.load(std::memory_order_relaxed);
+		}
+		
+		inline uint64_t GetHits() const
+		{
+			return m_hits.load(std::memory_order_relaxed);
+		}
+		
+		inline uint64_t GetMisses() const
+		{
+			return m_misses.load(std::memory_order_relaxed);
+		}
+		
+	private:
+		struct TileKey
+		{
+			RegionCoordinate m_coordinate;
+			uint32_t m_noiseID;
+			
+			inline bool operator==(const TileKey& other) const
+			{
+				return m_coordinate == other.m_coordinate && m_noiseID == other.m_noiseID;
+			}
+		};
+		
+		struct TileKeyHash
+		{
+			inline size_t operator()(const TileKey& key) const
+			{
+				return RegionCoordinateHash()(key.m_coordinate) ^ (key.m_noiseID * 0x9E3779B9U);
+			}
+		};
+		
+		struct Entry
+		{
+			TileKey m_key;
+			std::shared_ptr<const Tile> m_tile;
+		};
+		
+		//Drops the least recently used entries until at most m_capacity are left. The mutex must be held.
+		void Evict();
+		
+		std::mutex m_mutex;
+		
+		//Entries ordered from most to least recently used.
+		std::list<Entry> m_entries;
+		std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> m_entryMap;
+		
+		std::atomic<size_t> m_capacity;
+		
+		std::atomic<uint64_t> m_hits { 0 };
+		std::atomic<uint64_t> m_misses { 0 };
+	};
+}
@@ -0,0 +1,552 @@
+#include "perlinnoise.h"
+#include "../utils.h"
+
+#include <libnoise/module/perlin.h>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MCR_PERLIN_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MCR_PERLIN_SSE2
+#endif
+
+namespace MCR
+{
+	//Constants used by libnoise to hash lattice coordinates into the gradient table.
+	constexpr uint32_t xNoiseGen = 1619;
+	constexpr uint32_t yNoiseGen = 31337;
+	constexpr uint32_t zNoiseGen = 6971;
+	constexpr uint32_t seedNoiseGen = 1013;
+	constexpr uint32_t shiftNoiseGen = 8;
+	
+	//libnoise scales gradient noise by this to bring it roughly into [-1, 1].
+	constexpr double gradientScale = 2.12;
+	
+	//libnoise wraps coordinates into this range so that lattice coordinates fit in 32 bit integers.
+	constexpr double int32Range = 1073741824.0;
+	
+	struct GradientTable
+	{
+		alignas(32) double m_x[256];
+		alignas(32) double m_y[256];
+		alignas(32) double m_z[256];
+	};
+	
+	inline uint32_t GetGradientIndex(uint32_t hash)
+	{
+		return (hash ^ (hash >> shiftNoiseGen)) & 0xff;
+	}
+	
+	//Recovers libnoise's gradient vectors by evaluating GradientNoise3D one unit away from lattice points along the
+	//x axis, whose hashes cover every entry in the table within the first thousand points.
+	static GradientTable CreateGradientTable()
+	{
+		GradientTable table;
+		std::array<bool, 256> found { };
+		size_t numFound = 0;
+		
+		for (int ix = 0; numFound < found.size(); ix++)
+		{
+			const uint32_t index = GetGradientIndex(xNoiseGen * static_cast<uint32_t>(ix));
+			if (found[index])
+				continue;
+			
+			table.m_x[index] = noise::GradientNoise3D(ix + 1, 0, 0, ix, 0, 0, 0) / gradientScale;
+			table.m_y[index] = noise::GradientNoise3D(ix, 1, 0, ix, 0, 0, 0) / gradientScale;
+			table.m_z[index] = noise::GradientNoise3D(ix, 0, 1, ix, 0, 0, 0) / gradientScale;
+			
+			found[index] = true;
+			numFound++;
+		}
+		
+		return table;
+	}
+	
+	static const GradientTable& GetGradientTable()
+	{
+		static const GradientTable table = CreateGradientTable();
+		return table;
+	}
+	
+	inline double MakeInt32Range(double n)
+	{
+		if (n >= int32Range)
+			return 2.0 * std::fmod(n, int32Range) - int32Range;
+		if (n <= -int32Range)
+			return 2.0 * std::fmod(n, int32Range) + int32Range;
+		return n;
+	}
+	
+	//Each of the Ops structs below implements the operations used by the noise functions for one instruction set.
+	//The operations are done in the same order as in libnoise, and are never fused, so all of them give the same
+	//results.
+	struct ScalarOps
+	{
+		using Vec = double;
+		using IVec = uint32_t;
+		
+		static constexpr size_t Lanes = 1;
+		
+		static inline Vec Set1(double value) { return value; }
+		static inline Vec Load(const double* values) { return *values; }
+		static inline void Store(double* values, Vec vec) { *values = vec; }
+		
+		static inline Vec Add(Vec a, Vec b) { return a + b; }
+		static inline Vec Sub(Vec a, Vec b) { return a - b; }
+		static inline Vec Mul(Vec a, Vec b) { return a * b; }
+		
+		static inline Vec MakeInt32Range(Vec vec)
+		{
+			return MCR::MakeInt32Range(vec);
+		}
+		
+		//Rounds like libnoise, which rounds down but also subtracts one from negative integers.
+		static inline void LatticeFloor(Vec vec, Vec& floor, IVec& intFloor)
+		{
+			const int value = vec > 0.0 ? static_cast<int>(vec) : static_cast<int>(vec) - 1;
+			floor = value;
+			intFloor = static_cast<uint32_t>(value);
+		}
+		
+		static inline IVec HashLattice(IVec x, IVec y, IVec z, uint32_t seed)
+		{
+			return xNoiseGen * x + yNoiseGen * y + zNoiseGen * z + seedNoiseGen * seed;
+		}
+		
+		static inline void GetGradient(const GradientTable& table, IVec hash, Vec& x, Vec& y, Vec& z)
+		{
+			const uint32_t index = GetGradientIndex(hash);
+			x = table.m_x[index];
+			y = table.m_y[index];
+			z = table.m_z[index];
+		}
+		
+		static inline IVec AddHash(IVec hash, uint32_t offset)
+		{
+			return hash + offset;
+		}
+	};
+	
+#if defined(MCR_PERLIN_AVX2)
+	struct AVX2Ops
+	{
+		using Vec = __m256d;
+		using IVec = __m128i;
+		
+		static constexpr size_t Lanes = 4;
+		
+		static inline Vec Set1(double value) { return _mm256_set1_pd(value); }
+		static inline Vec Load(const double* values) { return _mm256_loadu_pd(values); }
+		static inline void Store(double* values, Vec vec) { _mm256_storeu_pd(values, vec); }
+		
+		static inline Vec Add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+		static inline Vec Sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+		static inline Vec Mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+		
+		static inline Vec MakeInt32Range(Vec vec)
+		{
+			const Vec outside = _mm256_or_pd(_mm256_cmp_pd(vec, Set1(int32Range), _CMP_GE_OQ),
+			                                 _mm256_cmp_pd(vec, Set1(-int32Range), _CMP_LE_OQ));
+			if (_mm256_movemask_pd(outside) == 0)
+				return vec;
+			
+			alignas(32) double values[Lanes];
+			_mm256_store_pd(values, vec);
+			for (double& value : values)
+			{
+				value = MCR::MakeInt32Range(value);
+			}
+			return _mm256_load_pd(values);
+		}
+		
+		static inline void LatticeFloor(Vec vec, Vec& floor, IVec& intFloor)
+		{
+			const Vec truncated = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(vec));
+			const Vec notPositive = _mm256_cmp_pd(vec, _mm256_setzero_pd(), _CMP_LE_OQ);
+			floor = _mm256_sub_pd(truncated, _mm256_and_pd(notPositive, Set1(1.0)));
+			intFloor = _mm256_cvttpd_epi32(floor);
+		}
+		
+		static inline IVec HashLattice(IVec x, IVec y, IVec z, uint32_t seed)
+		{
+			IVec hash = _mm_mullo_epi32(x, _mm_set1_epi32(xNoiseGen));
+			hash = _mm_add_epi32(hash, _mm_mullo_epi32(y, _mm_set1_epi32(yNoiseGen)));
+			hash = _mm_add_epi32(hash, _mm_mullo_epi32(z, _mm_set1_epi32(zNoiseGen)));
+			return _mm_add_epi32(hash, _mm_set1_epi32(static_cast<int>(seedNoiseGen * seed)));
+		}
+		
+		static inline void GetGradient(const GradientTable& table, IVec hash, Vec& x, Vec& y, Vec& z)
+		{
+			IVec index = _mm_xor_si128(hash, _mm_srli_epi32(hash, shiftNoiseGen));
+			index = _mm_and_si128(index, _mm_set1_epi32(0xff));
+			
+			//The masked gather is used since GCC warns about the undefined source of the unmasked one.
+			const Vec zero = _mm256_setzero_pd();
+			const Vec mask = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+			x = _mm256_mask_i32gather_pd(zero, table.m_x, index, mask, sizeof(double));
+			y = _mm256_mask_i32gather_pd(zero, table.m_y, index, mask, sizeof(double));
+			z = _mm256_mask_i32gather_pd(zero, table.m_z, index, mask, sizeof(double));
+		}
+		
+		static inline IVec AddHash(IVec hash, uint32_t offset)
+		{
+			return _mm_add_epi32(hash, _mm_set1_epi32(static_cast<int>(offset)));
+		}
+	};
+	
+	using BatchOps = AVX2Ops;
+#elif defined(MCR_PERLIN_SSE2)
+	//SSE2 has no 32 bit integer multiplication or gathers, so hashing and table lookups are done per lane.
+	struct SSE2Ops
+	{
+		using Vec = __m128d;
+		
+		static constexpr size_t Lanes = 2;
+		
+		struct IVec
+		{
+			uint32_t m_lanes[Lanes];
+		};
+		
+		static inline Vec Set1(double value) { return _mm_set1_pd(value); }
+		static inline Vec Load(const double* values) { return _mm_loadu_pd(values); }
+		static inline void Store(double* values, Vec vec) { _mm_storeu_pd(values, vec); }
+		
+		static inline Vec Add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+		static inline Vec Sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+		static inline Vec Mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+		
+		static inline Vec MakeInt32Range(Vec vec)
+		{
+			const Vec outside = _mm_or_pd(_mm_cmpge_pd(vec, Set1(int32Range)), _mm_cmple_pd(vec, Set1(-int32Range)));
+			if (_mm_movemask_pd(outside) == 0)
+				return vec;
+			
+			alignas(16) double values[Lanes];
+			_mm_store_pd(values, vec);
+			for (double& value : values)
+			{
+				value = MCR::MakeInt32Range(value);
+			}
+			return _mm_load_pd(values);
+		}
+		
+		static inline void LatticeFloor(Vec vec, Vec& floor, IVec& intFloor)
+		{
+			const Vec truncated = _mm_cvtepi32_pd(_mm_cvttpd_epi32(vec));
+			const Vec notPositive = _mm_cmple_pd(vec, _mm_setzero_pd());
+			floor = _mm_sub_pd(truncated, _mm_and_pd(notPositive, Set1(1.0)));
+			
+			alignas(16) int32_t lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_cvttpd_epi32(floor));
+			for (size_t i = 0; i < Lanes; i++)
+			{
+				intFloor.m_lanes[i] = static_cast<uint32_t>(lanes[i]);
+			}
+		}
+		
+		static inline IVec HashLattice(IVec x, IVec y, IVec z, uint32_t seed)
+		{
+			IVec hash;
+			for (size_t i = 0; i < Lanes; i++)
+			{
+				hash.m_lanes[i] = ScalarOps::HashLattice(x.m_lanes[i], y.m_lanes[i], z.m_lanes[i], seed);
+			}
+			return hash;
+		}
+		
+		static inline void GetGradient(const GradientTable& table, IVec hash, Vec& x, Vec& y, Vec& z)
+		{
+			const uint32_t index0 = GetGradientIndex(hash.m_lanes[0]);
+			const uint32_t index1 = GetGradientIndex(hash.m_lanes[1]);
+			x = _mm_set_pd(table.m_x[index1], table.m_x[index0]);
+			y = _mm_set_pd(table.m_y[index1], table.m_y[index0]);
+			z = _mm_set_pd(table.m_z[index1], table.m_z[index0]);
+		}
+		
+		static inline IVec AddHash(IVec hash, uint32_t offset)
+		{
+			for (uint32_t& lane : hash.m_lanes)
+			{
+				lane += offset;
+			}
+			return hash;
+		}
+	};
+	
+	using BatchOps = SSE2Ops;
+#else
+	using BatchOps = ScalarOps;
+#endif
+	
+	template <typename Ops>
+	inline typename Ops::Vec SCurve(typename Ops::Vec a, noise::NoiseQuality quality)
+	{
+		using Vec = typename Ops::Vec;
+		
+		switch (quality)
+		{
+		case noise::QUALITY_FAST:
+			return a;
+		case noise::QUALITY_STD:
+			return Ops::Mul(Ops::Mul(a, a), Ops::Sub(Ops::Set1(3.0), Ops::Mul(Ops::Set1(2.0), a)));
+		default:
+		{
+			const Vec a3 = Ops::Mul(Ops::Mul(a, a), a);
+			const Vec a4 = Ops::Mul(a3, a);
+			const Vec a5 = Ops::Mul(a4, a);
+			return Ops::Add(Ops::Sub(Ops::Mul(Ops::Set1(6.0), a5), Ops::Mul(Ops::Set1(15.0), a4)),
+			                Ops::Mul(Ops::Set1(10.0), a3));
+		}
+		}
+	}
+	
+	template <typename Ops>
+	inline typename Ops::Vec Lerp(typename Ops::Vec n0, typename Ops::Vec n1, typename Ops::Vec a)
+	{
+		return Ops::Add(Ops::Mul(Ops::Sub(Ops::Set1(1.0), a), n0), Ops::Mul(a, n1));
+	}
+	
+	//Equivalent to noise::GradientCoherentNoise3D.
+	template <typename Ops>
+	static typename Ops::Vec CoherentNoise(const GradientTable& table, typename Ops::Vec x, typename Ops::Vec y,
+	                                       typename Ops::Vec z, uint32_t seed, noise::NoiseQuality quality)
+	{
+		using Vec = typename Ops::Vec;
+		using IVec = typename Ops::IVec;
+		
+		Vec x0, y0, z0;
+		IVec ix0, iy0, iz0;
+		Ops::LatticeFloor(x, x0, ix0);
+		Ops::LatticeFloor(y, y0, iy0);
+		Ops::LatticeFloor(z, z0, iz0);
+		
+		const Vec one = Ops::Set1(1.0);
+		const Vec x1 = Ops::Add(x0, one);
+		const Vec y1 = Ops::Add(y0, one);
+		const Vec z1 = Ops::Add(z0, one);
+		
+		const Vec xs = SCurve<Ops>(Ops::Sub(x, x0), quality);
+		const Vec ys = SCurve<Ops>(Ops::Sub(y, y0), quality);
+		const Vec zs = SCurve<Ops>(Ops::Sub(z, z0), quality);
+		
+		//The hash is linear in the lattice coordinates, so the other corners are offsets from the first one.
+		const IVec hash = Ops::HashLattice(ix0, iy0, iz0, seed);
+		
+		//Equivalent to noise::GradientNoise3D.
+		auto gradientNoise = [&] (uint32_t hashOffset, Vec cornerX, Vec cornerY, Vec cornerZ)
+		{
+			Vec gradientX, gradientY, gradientZ;
+			Ops::GetGradient(table, Ops::AddHash(hash, hashOffset), gradientX, gradientY, gradientZ);
+			
+			const Vec dot = Ops::Add(Ops::Add(Ops::Mul(gradientX, Ops::Sub(x, cornerX)),
+			                                  Ops::Mul(gradientY, Ops::Sub(y, cornerY))),
+			                         Ops::Mul(gradientZ, Ops::Sub(z, cornerZ)));
+			return Ops::Mul(dot, Ops::Set1(gradientScale));
+		};
+		
+		Vec ix0Value = Lerp<Ops>(gradientNoise(0, x0, y0, z0), gradientNoise(xNoiseGen, x1, y0, z0), xs);
+		Vec ix1Value = Lerp<Ops>(gradientNoise(yNoiseGen, x0, y1, z0),
+		                         gradientNoise(xNoiseGen + yNoiseGen, x1, y1, z0), xs);
+		const Vec iy0Value = Lerp<Ops>(ix0Value, ix1Value, ys);
+		
+		ix0Value = Lerp<Ops>(gradientNoise(zNoiseGen, x0, y0, z1),
+		                     gradientNoise(xNoiseGen + zNoiseGen, x1, y0, z1), xs);
+		ix1Value = Lerp<Ops>(gradientNoise(yNoiseGen + zNoiseGen, x0, y1, z1),
+		                     gradientNoise(xNoiseGen + yNoiseGen + zNoiseGen, x1, y1, z1), xs);
+		const Vec iy1Value = Lerp<Ops>(ix0Value, ix1Value, ys);
+		
+		return Lerp<Ops>(iy0Value, iy1Value, zs);
+	}
+	
+	template <typename Ops>
+	typename Ops::Vec PerlinNoise::Evaluate(typename Ops::Vec x, typename Ops::Vec y, typename Ops::Vec z) const
+	{
+		using Vec = typename Ops::Vec;
+		
+		const GradientTable& table = GetGradientTable();
+		
+		x = Ops::Mul(x, Ops::Set1(m_frequency));
+		y = Ops::Mul(y, Ops::Set1(m_frequency));
+		z = Ops::Mul(z, Ops::Set1(m_frequency));
+		
+		Vec value = Ops::Set1(0.0);
+		double persistence = 1.0;
+		
+		for (int octave = 0; octave < m_octaveCount; octave++)
+		{
+			const uint32_t seed = static_cast<uint32_t>(m_seed) + static_cast<uint32_t>(octave);
+			const Vec signal = CoherentNoise<Ops>(table, Ops::MakeInt32Range(x), Ops::MakeInt32Range(y),
+			                                      Ops::MakeInt32Range(z), seed, m_quality);
+			value = Ops::Add(value, Ops::Mul(signal, Ops::Set1(persistence)));
+			
+			x = Ops::Mul(x, Ops::Set1(m_lacunarity));
+			y = Ops::Mul(y, Ops::Set1(m_lacunarity));
+			z = Ops::Mul(z, Ops::Set1(m_lacunarity));
+			persistence *= m_persistence;
+		}
+		
+		return value;
+	}
+	
+	double PerlinNoise::GetValue(double x, double y, double z) const
+	{
+		return Evaluate<ScalarOps>(x, y, z);
+	}
+	
+	void PerlinNoise::FillColumn(double x, double z, const double* ys, size_t count, double* values) const
+	{
+		const BatchOps::Vec xVec = BatchOps::Set1(x);
+		const BatchOps::Vec zVec = BatchOps::Set1(z);
+		
+		size_t i = 0;
+		for (; i + BatchOps::Lanes <= count; i += BatchOps::Lanes)
+		{
+			BatchOps::Store(values + i, Evaluate<BatchOps>(xVec, BatchOps::Load(ys + i), zVec));
+		}
+		
+		for (; i < count; i++)
+		{
+			values[i] = GetValue(x, ys[i], z);
+		}
+	}
+	
+	void PerlinNoise::FillSlab(const double* xs, size_t width, double y, const double* zs, size_t depth,
+	                           double* values) const
+	{
+		const BatchOps::Vec yVec = BatchOps::Set1(y);
+		
+		for (size_t iz = 0; iz < depth; iz++)
+		{
+			const BatchOps::Vec zVec = BatchOps::Set1(zs[iz]);
+			double* rowValues = values + iz * width;
+			
+			size_t ix = 0;
+			for (; ix + BatchOps::Lanes <= width; ix += BatchOps::Lanes)
+			{
+				BatchOps::Store(rowValues + ix, Evaluate<BatchOps>(BatchOps::Load(xs + ix), yVec, zVec));
+			}
+			
+			for (; ix < width; ix++)
+			{
+				rowValues[ix] = GetValue(xs[ix], y, zs[iz]);
+			}
+		}
+	}
+	
+	const char* PerlinNoise::GetInstructionSet()
+	{
+#if defined(MCR_PERLIN_AVX2)
+		return "AVX2";
+#elif defined(MCR_PERLIN_SSE2)
+		return "SSE2";
+#else
+		return "scalar";
+#endif
+	}
+	
+	void PerlinNoise::CompareWithLibnoise(uint32_t numPoints)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		
+		struct NoiseSettings
+		{
+			const char* m_name;
+			double m_frequency;
+			double m_lacunarity;
+			double m_persistence;
+			int m_octaveCount;
+			noise::NoiseQuality m_quality;
+		};
+		
+		//The terrain height and ocean noises from the world generator, and libnoise's defaults with each quality.
+		const NoiseSettings settingsList[] =
+		{
+			{ "height", 1.0 / 4.0, 2.0, 0.5, 4, noise::QUALITY_BEST },
+			{ "ocean", 1.0 / 64.0, 1.0, 0.9, 6, noise::QUALITY_BEST },
+			{ "fast", 1.0, 2.0, 0.5, 6, noise::QUALITY_FAST },
+			{ "standard", 1.0, 2.0, 0.5, 6, noise::QUALITY_STD }
+		};
+		
+		//Points are sampled in columns, the way the world generator samples the terrain density.
+		const uint32_t columnHeight = 64;
+		const uint32_t numColumns = std::max(numPoints / columnHeight, 1U);
+		
+		std::mt19937 random(numPoints);
+		std::uniform_real_distribution<double> horizontalDist(-10000.0, 10000.0);
+		std::uniform_real_distribution<double> verticalDist(0.0, 10.0);
+		
+		std::vector<double> xs(numColumns);
+		std::vector<double> zs(numColumns);
+		std::vector<double> ys(numColumns * columnHeight);
+		for (uint32_t c = 0; c < numColumns; c++)
+		{
+			xs[c] = horizontalDist(random);
+			zs[c] = horizontalDist(random);
+			for (uint32_t i = 0; i < columnHeight; i++)
+			{
+				ys[c * columnHeight + i] = verticalDist(random);
+			}
+		}
+		
+		std::vector<double> expected(ys.size());
+		std::vector<double> values(ys.size());
+		
+		for (const NoiseSettings& settings : settingsList)
+		{
+			noise::module::Perlin libnoisePerlin;
+			PerlinNoise perlin;
+			
+			libnoisePerlin.SetFrequency(settings.m_frequency);
+			libnoisePerlin.SetLacunarity(settings.m_lacunarity);
+			libnoisePerlin.SetPersistence(settings.m_persistence);
+			libnoisePerlin.SetOctaveCount(settings.m_octaveCount);
+			libnoisePerlin.SetNoiseQuality(settings.m_quality);
+			libnoisePerlin.SetSeed(static_cast<int>(numPoints));
+			
+			perlin.SetFrequency(settings.m_frequency);
+			perlin.SetLacunarity(settings.m_lacunarity);
+			perlin.SetPersistence(settings.m_persistence);
+			perlin.SetOctaveCount(settings.m_octaveCount);
+			perlin.SetNoiseQuality(settings.m_quality);
+			perlin.SetSeed(static_cast<int>(numPoints));
+			
+			auto libnoiseStartTime = Clock::now();
+			for (uint32_t c = 0; c < numColumns; c++)
+			{
+				for (uint32_t i = 0; i < columnHeight; i++)
+				{
+					const size_t index = c * columnHeight + i;
+					expected[index] = libnoisePerlin.GetValue(xs[c], ys[index], zs[c]);
+				}
+			}
+			
+			auto startTime = Clock::now();
+			for (uint32_t c = 0; c < numColumns; c++)
+			{
+				perlin.FillColumn(xs[c], zs[c], &ys[c * columnHeight], columnHeight, &values[c * columnHeight]);
+			}
+			auto endTime = Clock::now();
+			
+			double maxDifference = 0;
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				maxDifference = std::max(maxDifference, std::abs(values[i] - expected[i]));
+			}
+			
+			const std::chrono::duration<double, std::nano> libnoiseTime = startTime - libnoiseStartTime;
+			const std::chrono::duration<double, std::nano> time = endTime - startTime;
+			
+			Log("Perlin noise (", settings.m_name, "): max difference ", maxDifference, ", libnoise ",
+			    libnoiseTime.count() / values.size(), "ns/point, ", GetInstructionSet(), " ",
+			    time.count() / values.size(), "ns/point (", libnoiseTime.count() / time.count(), "x).");
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <libnoise/noisegen.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace MCR
+{
+	//Perlin noise which gives the same values as libnoise's Perlin module with the same settings, but can evaluate
+	//many points per call. Batches of points are evaluated with AVX2 (4 points at a time) or SSE2 (2 points at a time)
+	//when the compiler targets them, otherwise one point at a time. libnoise's gradient table isn't public, so it is
+	//recovered through noise::GradientNoise3D, which makes values differ from libnoise by rounding errors only.
+	class PerlinNoise
+	{
+	public:
+		PerlinNoise() = default;
+		
+		inline void SetFrequency(double frequency)
+		{
+			m_frequency = frequency;
+		}
+		
+		inline void SetLacunarity(double lacunarity)
+		{
+			m_lacunarity = lacunarity;
+		}
+		
+		inline void SetPersistence(double persistence)
+		{
+			m_persistence = persistence;
+		}
+		
+		inline void SetOctaveCount(int octaveCount)
+		{
+			m_octaveCount = octaveCount;
+		}
+		
+		inline void SetNoiseQuality(noise::NoiseQuality quality)
+		{
+			m_quality = quality;
+		}
+		
+		inline void SetSeed(int seed)
+		{
+			m_seed = seed;
+		}
+		
+		double GetValue(double x, double y, double z) const;
+		
+		//Evaluates the noise along a column, values[i] = GetValue(x, ys[i], z).
+		void FillColumn(double x, double z, const double* ys, size_t count, double* values) const;
+		
+		//Evaluates the noise over a horizontal slab, values[iz * width + ix] = GetValue(xs[ix], y, zs[iz]).
+		void FillSlab(const double* xs, size_t width, double y, const double* zs, size_t depth, double* values) const;
+		
+		//The name of the instruction set batches are evaluated with.
+		static const char* GetInstructionSet();
+		
+		//Evaluates random points with this class and with libnoise for a few settings, and logs the largest difference
+		//between them along with the time taken by each.
+		static void CompareWithLibnoise(uint32_t numPoints);
+		
+	private:
+		template <typename Ops>
+		typename Ops::Vec Evaluate(typename Ops::Vec x, typename Ops::Vec y, typename Ops::Vec z) const;
+		
+		double m_frequency = 1.0;
+		double m_lacunarity = 2.0;
+		double m_persistence = 0.5;
+		int m_octaveCount = 6;
+		noise::NoiseQuality m_quality = noise::QUALITY_STD;
+		int m_seed = 0;
+	};
+}
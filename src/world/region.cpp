@@ -1,9 +1,15 @@
 #include "region.h"
 #include "../blocks/blocktype.h"
 #include "../blocks/ids.h"
+#include "../blocks/sides.h"
+#include "../utils.h"
 
 #include <stack>
+#include <vector>
 #include <algorithm>
+#include <random>
+#include <chrono>
+#include <atomic>
 
 namespace MCR
 {
@@ -12,59 +18,557 @@ namespace MCR
 	constexpr int Region::BlockCount;
 	constexpr size_t Region::DataBufferBytes;
 	
-	void Region::ReadChunk(uint32_t index, std::istream& stream)
+	//Versions are unique across all regions, so a recycled region never repeats the version of an earlier chunk.
+	static std::atomic<uint64_t> nextChunkVersion(1);
+	
+	Region::Region(int64_t coordX, int64_t coordZ)
+	    : m_coordX(coordX), m_coordZ(coordZ)
 	{
-		const uint32_t blocksPerChunk = Size * Size * Size;
-		stream.read(reinterpret_cast<char*>(&m_blocks[index * blocksPerChunk]),
-		            blocksPerChunk * sizeof(BlockEntry));
+		for (std::shared_ptr<Chunk>& chunk : m_chunks)
+		{
+			chunk = std::make_shared<Chunk>();
+			chunk->m_version = nextChunkVersion++;
+		}
+		
+		m_maxSolidY.fill(-1);
+		m_maxNonAirY.fill(-1);
 	}
 	
-	void Region::WriteChunk(uint32_t index, std::ostream& stream) const
+	void Region::Reset(int64_t coordX, int64_t coordZ)
 	{
-		const uint32_t blocksPerChunk = Size * Size * Size;
-		stream.write(reinterpret_cast<const char*>(&m_blocks[index * blocksPerChunk]),
-		             blocksPerChunk * sizeof(BlockEntry));
+		SetPosition(coordX, coordZ);
+		
+		for (std::shared_ptr<Chunk>& chunk : m_chunks)
+		{
+			//Chunks still referenced by snapshots are replaced, the others are cleared to reuse their buffers.
+			if (chunk.use_count() > 1)
+			{
+				chunk = std::make_shared<Chunk>();
+			}
+			else
+			{
+				chunk->m_blocks.Clear();
+				chunk->m_opaqueMask.Clear();
+				chunk->m_waterMask.Clear();
+				chunk->m_numOpaque = 0;
+				chunk->m_numWater = 0;
+			}
+			chunk->m_version = nextChunkVersion++;
+		}
+		
+		m_snapshotTaken.reset();
+		m_staleChunks.reset();
+		m_dirtyChunks.store(0, std::memory_order_relaxed);
+		
+		m_maxSolidY.fill(-1);
+		m_maxNonAirY.fill(-1);
+		m_regionMaxNonAirY = -1;
+		m_regionMinSolidY = -1;
+	}
+	
+	Region::Chunk& Region::GetMutableChunk(uint32_t index)
+	{
+		std::shared_ptr<Chunk>& chunk = m_chunks[index];
+		if (chunk.use_count() > 1)
+			chunk = std::make_shared<Chunk>(*chunk);
+		
+		if (m_snapshotTaken[index])
+		{
+			chunk->m_version = nextChunkVersion++;
+			m_snapshotTaken.reset(index);
+		}
+		
+		return *chunk;
+	}
+	
+	std::shared_ptr<const Region::Chunk> Region::GetChunkSnapshot(uint32_t index) const
+	{
+		m_snapshotTaken.set(index);
+		return m_chunks[index];
+	}
+	
+	void Region::ReadChunk(uint32_t index, gsl::span<const BlockEntry> blocks)
+	{
+		Chunk& chunk = GetMutableChunk(index);
+		chunk.m_blocks.Read(blocks.data());
+		UpdateChunkMasks(chunk);
+		MarkChunkDirty(index);
+	}
+	
+	void Region::UpdateChunkMasks(Chunk& chunk)
+	{
+		const ChunkStorage& blocks = chunk.m_blocks;
+		if (blocks.IsUniform())
+		{
+			FillChunk(chunk, blocks.GetUniformEntry());
+			return;
+		}
+		
+		//Looks up the opacity of each palette entry once, rather than once per block.
+		const std::vector<BlockEntry>& palette = blocks.GetPalette();
+		std::vector<uint8_t> paletteIsOpaque(palette.size());
+		std::vector<uint8_t> paletteIsWater(palette.size());
+		for (size_t i = 0; i < palette.size(); i++)
+		{
+			paletteIsOpaque[i] = BlockType::GetByID(palette[i].m_id).IsOpaque();
+			paletteIsWater[i] = palette[i].m_id == BlockIDs::Water;
+		}
+		
+		std::array<uint32_t, ChunkMask::RowCount> opaqueRows;
+		std::array<uint32_t, ChunkMask::RowCount> waterRows;
+		
+		int numOpaque = 0;
+		int numWater = 0;
+		
+		for (int row = 0; row < ChunkMask::RowCount; row++)
+		{
+			uint32_t opaqueRow = 0;
+			uint32_t waterRow = 0;
+			
+			for (int x = 0; x < Size; x++)
+			{
+				const uint32_t paletteIndex = blocks.GetPaletteIndex(static_cast<uint32_t>(row * Size + x));
+				opaqueRow |= static_cast<uint32_t>(paletteIsOpaque[paletteIndex]) << x;
+				waterRow |= static_cast<uint32_t>(paletteIsWater[paletteIndex]) << x;
+			}
+			
+			opaqueRows[row] = opaqueRow;
+			waterRows[row] = waterRow;
+			numOpaque += PopCount(opaqueRow);
+			numWater += PopCount(waterRow);
+		}
+		
+		chunk.m_numOpaque = numOpaque;
+		chunk.m_numWater = numWater;
+		
+		chunk.m_opaqueMask.Assign(opaqueRows.data());
+		chunk.m_waterMask.Assign(waterRows.data());
+	}
+	
+	void Region::WriteChunk(uint32_t index, gsl::span<BlockEntry> blocks) const
+	{
+		m_chunks[index]->m_blocks.Write(blocks.data());
+	}
+	
+	void Region::Compact()
+	{
+		const int blocksPerChunk = Size * Size * Size;
+		
+		for (uint32_t i = 0; i < ChunkCount; i++)
+		{
+			Chunk& chunk = GetMutableChunk(i);
+			chunk.m_blocks.Compact();
+			
+			//The masks are kept up to date by Set, but are left allocated once a bit has been changed.
+			if (chunk.m_numOpaque == 0 || chunk.m_numOpaque == blocksPerChunk)
+				chunk.m_opaqueMask.Fill(chunk.m_numOpaque != 0);
+			if (chunk.m_numWater == 0 || chunk.m_numWater == blocksPerChunk)
+				chunk.m_waterMask.Fill(chunk.m_numWater != 0);
+		}
+	}
+	
+	size_t Region::GetMemoryUsage() const
+	{
+		size_t memoryUsage = sizeof(Region);
+		for (const std::shared_ptr<Chunk>& chunk : m_chunks)
+		{
+			memoryUsage += sizeof(Chunk) + chunk->m_blocks.GetMemoryUsage() + chunk->m_opaqueMask.GetMemoryUsage() +
+			               chunk->m_waterMask.GetMemoryUsage();
+		}
+		return memoryUsage;
 	}
 	
 	bool Region::IsChunkAir(int y) const
 	{
-		if (m_opaquePerChunk[y] != 0)
+		const Chunk& chunk = *m_chunks[y];
+		if (chunk.m_numOpaque != 0)
 			return false;
 		
-		const uint32_t blocksPerChunk = Size * Size * Size;
-		uint32_t basePos = y * blocksPerChunk;
-		return std::all_of(m_blocks.begin() + basePos, m_blocks.begin() + basePos + blocksPerChunk,
-		                   [&] (const BlockEntry& block) { return block.m_id == BlockIDs::Air; });
+		if (chunk.m_blocks.IsUniform())
+			return chunk.m_blocks.GetUniformEntry().m_id == BlockIDs::Air;
+		
+		return chunk.m_blocks.OnlyContains({ BlockIDs::Air });
+	}
+	
+	void Region::FillChunk(uint32_t index, BlockEntry entry)
+	{
+		FillChunk(GetMutableChunk(index), entry);
+		MarkChunkDirty(index);
+	}
+	
+	void Region::FillChunk(Chunk& chunk, BlockEntry entry)
+	{
+		chunk.m_blocks.Fill(entry);
+		
+		const int blocksPerChunk = Size * Size * Size;
+		const bool opaque = BlockType::GetByID(entry.m_id).IsOpaque();
+		const bool water = entry.m_id == BlockIDs::Water;
+		
+		chunk.m_numOpaque = opaque ? blocksPerChunk : 0;
+		chunk.m_numWater = water ? blocksPerChunk : 0;
+		chunk.m_opaqueMask.Fill(opaque);
+		chunk.m_waterMask.Fill(water);
+	}
+	
+	void Region::WriteColumn(int locX, int locZ, int yBegin, gsl::span<const BlockEntry> blocks)
+	{
+		const int yEnd = yBegin + static_cast<int>(blocks.size());
+		CheckBounds(locX, yBegin, locZ);
+		CheckBounds(locX, yEnd - 1, locZ);
+		
+		for (int chunkIndex = yBegin / Size; chunkIndex * Size < yEnd; chunkIndex++)
+		{
+			ChunkStorage& chunkBlocks = GetMutableChunk(chunkIndex).m_blocks;
+			for (int y = std::max(yBegin, chunkIndex * Size); y < std::min(yEnd, (chunkIndex + 1) * Size); y++)
+			{
+				chunkBlocks.Set(GetChunkBlockIndex(locX, y % Size, locZ), blocks[y - yBegin]);
+			}
+			m_staleChunks.set(chunkIndex);
+			MarkChunkDirty(chunkIndex);
+		}
+	}
+	
+	void Region::FillColumn(int locX, int locZ, int yBegin, int yEnd, BlockEntry entry)
+	{
+		CheckBounds(locX, yBegin, locZ);
+		CheckBounds(locX, yEnd - 1, locZ);
+		
+		for (int chunkIndex = yBegin / Size; chunkIndex * Size < yEnd; chunkIndex++)
+		{
+			ChunkStorage& chunkBlocks = GetMutableChunk(chunkIndex).m_blocks;
+			for (int y = std::max(yBegin, chunkIndex * Size); y < std::min(yEnd, (chunkIndex + 1) * Size); y++)
+			{
+				chunkBlocks.Set(GetChunkBlockIndex(locX, y % Size, locZ), entry);
+			}
+			m_staleChunks.set(chunkIndex);
+			MarkChunkDirty(chunkIndex);
+		}
+	}
+	
+	void Region::UpdateStaleChunks()
+	{
+		if (m_staleChunks.none())
+			return;
+		
+		for (uint32_t i = 0; i < ChunkCount; i++)
+		{
+			if (m_staleChunks[i])
+			{
+				UpdateChunkMasks(GetMutableChunk(i));
+			}
+		}
+		m_staleChunks.reset();
+		
+		UpdateHeightMaps();
+	}
+	
+	void Region::UpdateHeightMaps()
+	{
+		m_maxSolidY.fill(-1);
+		m_maxNonAirY.fill(-1);
+		m_regionMaxNonAirY = -1;
+		
+		//Bit x of element z is set once the height of the column at (x, z) has been found.
+		std::array<uint32_t, Size> solidFound { };
+		std::array<uint32_t, Size> nonAirFound { };
+		int numColumnsLeft = 2 * Size * Size;
+		
+		auto SetHeights = [&] (std::array<int16_t, Size * Size>& heights, uint32_t& found, uint32_t row, int y, int z)
+		{
+			for (uint32_t remaining = row & ~found; remaining != 0; remaining &= remaining - 1)
+			{
+				heights[CountTrailingZeros(remaining) + z * Size] = static_cast<int16_t>(y);
+				numColumnsLeft--;
+			}
+			found |= row;
+		};
+		
+		//Scans down from the top of the region, stopping once the height of every column has been found.
+		for (int chunkIndex = ChunkCount - 1; chunkIndex >= 0 && numColumnsLeft > 0; chunkIndex--)
+		{
+			const Chunk& chunk = *m_chunks[chunkIndex];
+			if (chunk.m_blocks.IsUniform() && chunk.m_blocks.GetUniformEntry().m_id == BlockIDs::Air)
+				continue;
+			
+			const std::vector<BlockEntry>& palette = chunk.m_blocks.GetPalette();
+			std::vector<uint8_t> paletteIsAir(palette.size());
+			for (size_t i = 0; i < palette.size(); i++)
+			{
+				paletteIsAir[i] = palette[i].m_id == BlockIDs::Air;
+			}
+			
+			for (int chunkY = Size - 1; chunkY >= 0 && numColumnsLeft > 0; chunkY--)
+			{
+				const int y = chunkY + chunkIndex * Size;
+				
+				for (int z = 0; z < Size; z++)
+				{
+					SetHeights(m_maxSolidY, solidFound[z], chunk.GetOpaqueRow(chunkY, z), y, z);
+					
+					if (nonAirFound[z] == ~0U)
+						continue;
+					
+					uint32_t nonAirRow = 0;
+					for (uint32_t remaining = ~nonAirFound[z]; remaining != 0; remaining &= remaining - 1)
+					{
+						const uint32_t x = CountTrailingZeros(remaining);
+						const uint32_t paletteIndex = chunk.m_blocks.GetPaletteIndex(GetChunkBlockIndex(x, chunkY, z));
+						nonAirRow |= static_cast<uint32_t>(!paletteIsAir[paletteIndex]) << x;
+					}
+					
+					if (nonAirRow != 0 && m_regionMaxNonAirY == -1)
+						m_regionMaxNonAirY = y;
+					SetHeights(m_maxNonAirY, nonAirFound[z], nonAirRow, y, z);
+				}
+			}
+		}
+		
+		m_regionMinSolidY = *std::min_element(m_maxSolidY.begin(), m_maxSolidY.end());
+	}
+	
+	int Region::FindMaxSolidY(int locX, int locZ, int startY) const
+	{
+		for (int y = startY; y >= 0; y--)
+		{
+			//Skips entire chunks without opaque blocks.
+			if (m_chunks[y / Size]->m_numOpaque == 0)
+			{
+				y -= y % Size;
+				continue;
+			}
+			
+			if (IsBlockOpaque(locX, y, locZ))
+				return y;
+		}
+		return -1;
+	}
+	
+	int Region::FindMaxNonAirY(int locX, int locZ, int startY) const
+	{
+		for (int y = startY; y >= 0; y--)
+		{
+			//Skips entire chunks filled with air.
+			const ChunkStorage& blocks = m_chunks[y / Size]->m_blocks;
+			if (blocks.IsUniform() && blocks.GetUniformEntry().m_id == BlockIDs::Air)
+			{
+				y -= y % Size;
+				continue;
+			}
+			
+			if (Get(locX, y, locZ).m_id != BlockIDs::Air)
+				return y;
+		}
+		return -1;
 	}
 	
 	void Region::Set(int locX, int locY, int locZ, Region::BlockEntry newEntry)
 	{
-		const size_t index = GetBlockIndex(locX, locY, locZ);
+		CheckBounds(locX, locY, locZ);
+		
+		const int chunkIndex = locY / Size;
+		const int chunkY = locY % Size;
+		Chunk& chunk = GetMutableChunk(chunkIndex);
+		const BlockEntry oldEntry = chunk.m_blocks.Set(GetChunkBlockIndex(locX, chunkY, locZ), newEntry);
+		if (oldEntry != newEntry)
+		{
+			MarkChunkDirty(chunkIndex);
+		}
+		
+		const bool wasOpaque = BlockType::GetByID(oldEntry.m_id).IsOpaque();
+		const bool isOpaque = BlockType::GetByID(newEntry.m_id).IsOpaque();
+		if (wasOpaque != isOpaque)
+		{
+			chunk.m_numOpaque += isOpaque ? 1 : -1;
+			chunk.m_opaqueMask.Set(locX, chunkY, locZ, isOpaque);
+		}
+		
+		const bool wasWater = oldEntry.m_id == BlockIDs::Water;
+		const bool isWater = newEntry.m_id == BlockIDs::Water;
+		if (wasWater != isWater)
+		{
+			chunk.m_numWater += isWater ? 1 : -1;
+			chunk.m_waterMask.Set(locX, chunkY, locZ, isWater);
+		}
+		
+		//Updates the height maps, searching down for the next block if the top block of a column was removed.
+		int16_t& maxSolidY = m_maxSolidY[locX + locZ * Size];
+		const int oldMaxSolidY = maxSolidY;
+		if (isOpaque && locY > maxSolidY)
+			maxSolidY = static_cast<int16_t>(locY);
+		else if (!isOpaque && locY == maxSolidY)
+			maxSolidY = static_cast<int16_t>(FindMaxSolidY(locX, locZ, locY - 1));
+		
+		if (maxSolidY < m_regionMinSolidY)
+			m_regionMinSolidY = maxSolidY;
+		else if (oldMaxSolidY == m_regionMinSolidY && maxSolidY != oldMaxSolidY)
+			m_regionMinSolidY = *std::min_element(m_maxSolidY.begin(), m_maxSolidY.end());
 		
-		if (BlockType::GetByID(m_blocks[index].m_id).IsOpaque())
+		int16_t& maxNonAirY = m_maxNonAirY[locX + locZ * Size];
+		const bool isAir = newEntry.m_id == BlockIDs::Air;
+		if (!isAir && locY > maxNonAirY)
 		{
-			m_opaquePerChunk[locY / Size]--;
+			maxNonAirY = static_cast<int16_t>(locY);
+			m_regionMaxNonAirY = std::max(m_regionMaxNonAirY, locY);
 		}
+		else if (isAir && locY == maxNonAirY)
+		{
+			maxNonAirY = static_cast<int16_t>(FindMaxNonAirY(locX, locZ, locY - 1));
+			if (locY == m_regionMaxNonAirY)
+				m_regionMaxNonAirY = *std::max_element(m_maxNonAirY.begin(), m_maxNonAirY.end());
+		}
+	}
+	
+	//Expands the set bits of a row to cover the entire runs of open blocks they are in.
+	static inline uint32_t ExpandRow(uint32_t row, uint32_t openRow)
+	{
+		uint32_t up = row & openRow;
+		uint32_t down = up;
+		uint32_t upPropagate = openRow;
+		uint32_t downPropagate = openRow;
 		
-		if (BlockType::GetByID(newEntry.m_id).IsOpaque())
+		for (uint32_t shift = 1; shift < 32; shift *= 2)
 		{
-			m_opaquePerChunk[locY / Size]++;
+			up |= upPropagate & (up << shift);
+			upPropagate &= upPropagate << shift;
+			down |= downPropagate & (down >> shift);
+			downPropagate &= downPropagate >> shift;
 		}
 		
-		if (m_blocks[index].m_id == BlockIDs::Water)
+		return up | down;
+	}
+	
+	Region::ChunkConnectivity Region::CalculateConnectivity(const Chunk& chunk)
+	{
+		ChunkConnectivity connectivity;
+		
+		//Chunks without opaque blocks are fully connected, and fully opaque chunks are not connected at all.
+		if (chunk.m_numOpaque == 0)
 		{
-			m_waterPerChunk[locY / Size]--;
+			const bool touchedEdges[6] = { true, true, true, true, true, true };
+			connectivity.SetConnected(touchedEdges);
+			return connectivity;
 		}
+		if (chunk.IsOpaque())
+			return connectivity;
+		
+		constexpr int rowCount = ChunkMask::RowCount;
+		constexpr uint32_t xEdgeBits = 1U | (1U << (Size - 1));
 		
-		if (newEntry.m_id == BlockIDs::Water)
+		//Rows are indexed by z + y * Size, matching the layout of ChunkMask.
+		std::array<uint32_t, rowCount> openRows;
+		std::array<uint32_t, rowCount> visitedRows;
+		std::array<uint32_t, rowCount> fillRows;
+		
+		for (int row = 0; row < rowCount; row++)
 		{
-			m_waterPerChunk[locY / Size]++;
+			openRows[row] = ~chunk.GetOpaqueRow(row / Size, row % Size);
 		}
+		visitedRows.fill(0);
+		fillRows.fill(0);
 		
-		m_blocks[index] = newEntry;
+		for (int seedRow = 0; seedRow < rowCount; seedRow++)
+		{
+			//Flood fills only need to start from blocks at the edges of the chunk.
+			const int seedY = seedRow / Size;
+			const int seedZ = seedRow % Size;
+			const bool isEdgeRow = seedY == 0 || seedY == Size - 1 || seedZ == 0 || seedZ == Size - 1;
+			const uint32_t seedMask = isEdgeRow ? ~0U : xEdgeBits;
+			
+			while (uint32_t seeds = openRows[seedRow] & ~visitedRows[seedRow] & seedMask)
+			{
+				fillRows[seedRow] = seeds & (~seeds + 1);
+				
+				//The bounds of the rows which are part of the fill, used to limit the sweeps below.
+				int minY = seedY, maxY = seedY;
+				int minZ = seedZ, maxZ = seedZ;
+				
+				auto UpdateRow = [&] (int y, int z, uint32_t grow)
+				{
+					const int row = z + y * Size;
+					grow = ExpandRow(grow, openRows[row]);
+					if (grow == fillRows[row])
+						return false;
+					
+					fillRows[row] = grow;
+					minY = std::min(minY, y);
+					maxY = std::max(maxY, y);
+					minZ = std::min(minZ, z);
+					maxZ = std::max(maxZ, z);
+					return true;
+				};
+				
+				//Sweeps forward and backward over the rows, spreading the fill to neighboring rows and expanding it
+				//within each row, until the fill stops changing.
+				bool changed = true;
+				while (changed)
+				{
+					changed = false;
+					
+					for (int y = std::max(minY - 1, 0); y <= std::min(maxY + 1, Size - 1); y++)
+					{
+						for (int z = std::max(minZ - 1, 0); z <= std::min(maxZ + 1, Size - 1); z++)
+						{
+							const int row = z + y * Size;
+							uint32_t grow = fillRows[row];
+							if (z > 0)
+								grow |= fillRows[row - 1];
+							if (y > 0)
+								grow |= fillRows[row - Size];
+							
+							if (grow != 0 && UpdateRow(y, z, grow))
+								changed = true;
+						}
+					}
+					
+					for (int y = std::min(maxY + 1, Size - 1); y >= std::max(minY - 1, 0); y--)
+					{
+						for (int z = std::min(maxZ + 1, Size - 1); z >= std::max(minZ - 1, 0); z--)
+						{
+							const int row = z + y * Size;
+							uint32_t grow = fillRows[row];
+							if (z < Size - 1)
+								grow |= fillRows[row + 1];
+							if (y < Size - 1)
+								grow |= fillRows[row + Size];
+							
+							if (grow != 0 && UpdateRow(y, z, grow))
+								changed = true;
+						}
+					}
+				}
+				
+				bool touchedEdges[6];
+				touchedEdges[BLOCK_SIDE_POSX] = false;
+				touchedEdges[BLOCK_SIDE_NEGX] = false;
+				touchedEdges[BLOCK_SIDE_POSY] = maxY == Size - 1;
+				touchedEdges[BLOCK_SIDE_NEGY] = minY == 0;
+				touchedEdges[BLOCK_SIDE_POSZ] = maxZ == Size - 1;
+				touchedEdges[BLOCK_SIDE_NEGZ] = minZ == 0;
+				
+				//Marks the filled blocks as visited and clears the fill for the next seed.
+				for (int y = minY; y <= maxY; y++)
+				{
+					for (int z = minZ; z <= maxZ; z++)
+					{
+						uint32_t& fillRow = fillRows[z + y * Size];
+						if (fillRow & (1U << (Size - 1)))
+							touchedEdges[BLOCK_SIDE_POSX] = true;
+						if (fillRow & 1U)
+							touchedEdges[BLOCK_SIDE_NEGX] = true;
+						
+						visitedRows[z + y * Size] |= fillRow;
+						fillRow = 0;
+					}
+				}
+				
+				connectivity.SetConnected(touchedEdges);
+			}
+		}
+			
+		return connectivity;
 	}
 	
-	Region::ChunkConnectivity Region::CalculateConnectivity(uint32_t chunkIndex) const
+	Region::ChunkConnectivity Region::CalculateConnectivityReference(const Chunk& chunk)
 	{
 		ChunkConnectivity connectivity;
 		
@@ -81,11 +585,11 @@ namespace MCR
 		
 		std::bitset<blocksPerChunk> blocksVisited;
 		
-		const uint64_t baseBlockIndex = chunkIndex * blocksPerChunk;
+		const ChunkMask& opaqueMask = chunk.m_opaqueMask;
 		
-		auto GetChunkBlockIndex = [] (Coord coord)
+		auto GetCoordBlockIndex = [] (Coord coord)
 		{
-			return coord.x + (coord.z + coord.y * Size) * Size;
+			return GetChunkBlockIndex(coord.x, coord.y, coord.z);
 		};
 		
 		const uint8_t constCoordValues[6] = 
@@ -114,9 +618,9 @@ namespace MCR
 					
 					auto MaybePushCoord = [&] (Coord coord)
 					{
-						size_t index = GetChunkBlockIndex(coord);
+						uint32_t index = GetCoordBlockIndex(coord);
 						
-						if (blocksVisited[index] || BlockType::GetByID(m_blocks[baseBlockIndex + index].m_id).IsOpaque())
+						if (blocksVisited[index] || opaqueMask.Get(coord.x, coord.y, coord.z))
 							return false;
 						
 						coordinatesStack[coordinatesStackSize++] = coord;
@@ -162,20 +666,7 @@ namespace MCR
 						}
 					}
 					
-					//Marks all conbinations of touched edges as connected.
-					for (uint8_t s1 = 1; s1 < 6; s1++)
-					{
-						if (touchedEdges[s1])
-						{
-							for (uint8_t s2 = 0; s2 < s1; s2++)
-							{
-								if (touchedEdges[s2])
-								{
-									connectivity.SetConnected(s1, s2);
-								}
-							}
-						}
-					}
+					connectivity.SetConnected(touchedEdges);
 				}
 			}
 		}
@@ -208,4 +699,71 @@ namespace MCR
 	{
 		m_data |= GetConnectionMask(side1, side2);
 	}
+	
+	void Region::ChunkConnectivity::SetConnected(const bool touchedSides[6])
+	{
+		//Marks all conbinations of touched sides as connected.
+		for (uint8_t s1 = 1; s1 < 6; s1++)
+		{
+			if (touchedSides[s1])
+			{
+				for (uint8_t s2 = 0; s2 < s1; s2++)
+				{
+					if (touchedSides[s2])
+					{
+						SetConnected(s1, s2);
+					}
+				}
+			}
+		}
+	}
+
+	void Region::BenchmarkConnectivity(uint32_t numChunks)
+	{
+		std::mt19937 randomGen(static_cast<uint32_t>(numChunks));
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		
+		auto region = std::make_unique<Region>(0, 0);
+		
+		using DurationType = std::chrono::duration<double, std::milli>;
+		DurationType floodFillTime = DurationType::zero();
+		DurationType referenceTime = DurationType::zero();
+		uint32_t mismatches = 0;
+		
+		for (uint32_t i = 0; i < numChunks; i++)
+		{
+			//Varies the amount of opaque blocks between chunks, densities around 0.7 are close to the point where
+			//the open blocks stop percolating through the chunk, which produces the most complex connectivity.
+			const float opaqueProbability = 0.4f + 0.5f * (i % 10) / 10.0f;
+			
+			for (int y = 0; y < Size; y++)
+			{
+				for (int z = 0; z < Size; z++)
+				{
+					for (int x = 0; x < Size; x++)
+					{
+						const bool opaque = dist(randomGen) < opaqueProbability;
+						region->Set(x, y, z, { opaque ? BlockIDs::Stone : BlockIDs::Air });
+					}
+				}
+			}
+			
+			const Chunk& chunk = *region->m_chunks[0];
+			
+			auto startTime = std::chrono::high_resolution_clock::now();
+			const ChunkConnectivity connectivity = CalculateConnectivity(chunk);
+			auto floodFillEndTime = std::chrono::high_resolution_clock::now();
+			const ChunkConnectivity referenceConnectivity = CalculateConnectivityReference(chunk);
+			auto referenceEndTime = std::chrono::high_resolution_clock::now();
+			
+			floodFillTime += floodFillEndTime - startTime;
+			referenceTime += referenceEndTime - floodFillEndTime;
+			
+			if (connectivity.m_data != referenceConnectivity.m_data)
+				mismatches++;
+		}
+		
+		Log("Connectivity benchmark: ", mismatches, " mismatches in ", numChunks, " chunks. Flood fill: ",
+		    floodFillTime.count() / numChunks, "ms/chunk, DFS: ", referenceTime.count() / numChunks, "ms/chunk.");
+	}
 }
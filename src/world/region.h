@@ -3,7 +3,11 @@
 #include <cstdint>
 #include <memory>
 #include <bitset>
-#include "../vulkan/vk.h"
+#include <atomic>
+#include <gsl/span>
+#include "chunkstorage.h"
+#include "chunkmask.h"
+#include "../utils.h"
 
 namespace MCR
 {
@@ -30,17 +34,20 @@ namespace MCR
 		}
 	};
 	
-	//Moving is very slow!
+	struct RegionCoordinateHash
+	{
+		inline size_t operator()(RegionCoordinate coordinate) const
+		{
+			const uint64_t hash = static_cast<uint64_t>(coordinate.x) * 0x9E3779B97F4A7C15ULL ^
+			                      static_cast<uint64_t>(coordinate.z) * 0xC2B2AE3D27D4EB4FULL;
+			return static_cast<size_t>(hash ^ (hash >> 32));
+		}
+	};
+	
 	class Region
 	{
 	public:
-#pragma pack(push, 1)
-		struct BlockEntry
-		{
-			uint8_t m_id = 0;
-			uint8_t m_data = 0;
-		};
-#pragma pack(pop)
+		using BlockEntry = MCR::BlockEntry;
 		
 		class ChunkConnectivity
 		{
@@ -54,13 +61,46 @@ namespace MCR
 		private:
 			void SetConnected(uint8_t side1, uint8_t side2);
 			
+			//Marks every pair of sides which are both touched as connected, indexed using BLOCK_SIDE_*.
+			void SetConnected(const bool touchedSides[6]);
+			
 			uint16_t m_data;
 		};
 		
-		Region() = default;
+		//The blocks of one chunk along with the opacity and water data derived from them. Chunks are shared with the
+		//snapshots returned by GetChunkSnapshot and are never modified while shared, writes to a shared chunk go to a
+		//copy instead. The version changes whenever a chunk is modified after a snapshot of it has been taken.
+		struct Chunk
+		{
+			ChunkStorage m_blocks;
+			ChunkMask m_opaqueMask;
+			ChunkMask m_waterMask;
+			
+			int m_numOpaque = 0;
+			int m_numWater = 0;
+			
+			uint64_t m_version = 0;
+			
+			inline bool IsOpaque() const
+			{
+				return m_numOpaque == Size * Size * Size;
+			}
+			
+			inline bool HasWater() const
+			{
+				return m_numWater > 0;
+			}
+			
+			inline uint32_t GetOpaqueRow(int chunkY, int locZ) const
+			{
+				return m_opaqueMask.GetRow(chunkY, locZ);
+			}
+		};
+		
+		inline Region()
+		    : Region(0, 0) { }
 		
-		inline Region(int64_t coordX, int64_t coordZ)
-		    : m_coordX(coordX), m_coordZ(coordZ) { }
+		Region(int64_t coordX, int64_t coordZ);
 		
 		inline void SetPosition(int64_t coordX, int64_t coordZ)
 		{
@@ -68,6 +108,9 @@ namespace MCR
 			m_coordZ = coordZ;
 		}
 		
+		//Moves the region to a new position and fills it with air, keeping allocated chunk buffers for reuse.
+		void Reset(int64_t coordX, int64_t coordZ);
+		
 		inline void Set(glm::ivec3 locPos, BlockEntry newEntry)
 		{
 			return Set(locPos.x, locPos.y, locPos.z, newEntry);
@@ -75,14 +118,27 @@ namespace MCR
 		
 		void Set(int locX, int locY, int locZ, BlockEntry newEntry);
 		
+		//Replaces every block in a chunk with the given entry. The height maps are not updated until UpdateHeightMaps
+		//is called.
+		void FillChunk(uint32_t index, BlockEntry entry);
+		
+		//Bulk writes for generation. These only write the block data, the opacity and water data of the affected
+		//chunks is not updated until UpdateStaleChunks is called.
+		void WriteColumn(int locX, int locZ, int yBegin, gsl::span<const BlockEntry> blocks);
+		void FillColumn(int locX, int locZ, int yBegin, int yEnd, BlockEntry entry);
+		
+		//Recalculates the opacity and water data of chunks written to by WriteColumn and FillColumn.
+		void UpdateStaleChunks();
+		
 		inline BlockEntry Get(glm::ivec3 locPos) const
 		{
-			return m_blocks[GetBlockIndex(locPos.x, locPos.y, locPos.z)];
+			return Get(locPos.x, locPos.y, locPos.z);
 		}
 		
 		inline BlockEntry Get(int locX, int locY, int locZ) const
 		{
-			return m_blocks[GetBlockIndex(locX, locY, locZ)];
+			CheckBounds(locX, locY, locZ);
+			return m_chunks[locY / Size]->m_blocks.Get(GetChunkBlockIndex(locX, locY % Size, locZ));
 		}
 		
 		inline int64_t GetX() const
@@ -92,20 +148,123 @@ namespace MCR
 		
 		inline bool IsChunkOpaque(int y) const
 		{
-			return m_opaquePerChunk[y] == Size * Size * Size;
+			return m_chunks[y]->IsOpaque();
 		}
 		
 		inline bool ChunkHasWater(int y) const
 		{
-			return m_waterPerChunk[y] > 0;
+			return m_chunks[y]->HasWater();
 		}
 		
-		ChunkConnectivity CalculateConnectivity(uint32_t chunkIndex) const;
+		inline bool IsBlockOpaque(int locX, int locY, int locZ) const
+		{
+			CheckBounds(locX, locY, locZ);
+			return m_chunks[locY / Size]->m_opaqueMask.Get(locX, locY % Size, locZ);
+		}
+		
+		inline bool IsBlockWater(int locX, int locY, int locZ) const
+		{
+			CheckBounds(locX, locY, locZ);
+			return m_chunks[locY / Size]->m_waterMask.Get(locX, locY % Size, locZ);
+		}
+		
+		//Returns a mask of the opaque blocks in the row along the X-axis at the given local y and z coordinates.
+		inline uint32_t GetOpaqueRow(int locY, int locZ) const
+		{
+			CheckBounds(0, locY, locZ);
+			return m_chunks[locY / Size]->m_opaqueMask.GetRow(locY % Size, locZ);
+		}
+		
+		//Returns a mask of the water blocks in the row along the X-axis at the given local y and z coordinates.
+		inline uint32_t GetWaterRow(int locY, int locZ) const
+		{
+			CheckBounds(0, locY, locZ);
+			return m_chunks[locY / Size]->m_waterMask.GetRow(locY % Size, locZ);
+		}
+		
+		//Returns the y coordinate of the highest opaque block in a column, or -1 if the column has no opaque blocks.
+		inline int GetMaxSolidY(int locX, int locZ) const
+		{
+			CheckBounds(locX, 0, locZ);
+			return m_maxSolidY[locX + locZ * Size];
+		}
+		
+		//Returns the y coordinate of the highest block which isn't air in a column, or -1 if the column is empty.
+		inline int GetMaxNonAirY(int locX, int locZ) const
+		{
+			CheckBounds(locX, 0, locZ);
+			return m_maxNonAirY[locX + locZ * Size];
+		}
+		
+		//Returns the y coordinate of the highest block which isn't air in the region, or -1 if the region is empty.
+		inline int GetMaxNonAirY() const
+		{
+			return m_regionMaxNonAirY;
+		}
+		
+		//Returns the lowest value of GetMaxSolidY over all columns in the region.
+		inline int GetMinSolidY() const
+		{
+			return m_regionMinSolidY;
+		}
+		
+		//Calculates which sides of a chunk are connected through non-opaque blocks, using a flood fill over the rows
+		//of the chunk's opacity mask.
+		static ChunkConnectivity CalculateConnectivity(const Chunk& chunk);
+		
+		//Compares CalculateConnectivity against the per-block depth first search on random chunks, and logs the
+		//number of mismatches and the time taken by both.
+		static void BenchmarkConnectivity(uint32_t numChunks);
 		
 		bool IsChunkAir(int y) const;
 		
-		void ReadChunk(uint32_t index, std::istream& stream);
-		void WriteChunk(uint32_t index, std::ostream& stream) const;
+		//Reads or writes all blocks of a chunk, blocks must contain ChunkStorage::BlockCount entries. ReadChunk doesn't
+		//update the height maps, UpdateHeightMaps should be called once all chunks have been read.
+		void ReadChunk(uint32_t index, gsl::span<const BlockEntry> blocks);
+		void WriteChunk(uint32_t index, gsl::span<BlockEntry> blocks) const;
+		
+		//Recalculates the height of every column from the blocks in the region.
+		void UpdateHeightMaps();
+		
+		//Drops unused palette entries from all chunks and releases the block masks of chunks where all blocks are
+		//opaque (or not), should be called once a region has been fully generated.
+		void Compact();
+		
+		inline const ChunkStorage& GetChunk(uint32_t index) const
+		{
+			return m_chunks[index]->m_blocks;
+		}
+		
+		//Returns the current version of a chunk, which stays valid and unchanged even if the region is modified or
+		//reused afterwards. Must be called from the thread which owns the region.
+		std::shared_ptr<const Chunk> GetChunkSnapshot(uint32_t index) const;
+		
+		inline uint64_t GetChunkVersion(uint32_t index) const
+		{
+			return m_chunks[index]->m_version;
+		}
+		
+		//Returns true if any chunk has been modified since the region was loaded or last saved.
+		inline bool IsDirty() const
+		{
+			return m_dirtyChunks.load(std::memory_order_relaxed) != 0;
+		}
+		
+		//Clears the dirty bits of all chunks and returns a mask of the chunks which were dirty. Can be called while
+		//another thread modifies the region, modifications made after the call mark their chunks as dirty again.
+		inline uint32_t ClearDirtyChunks() const
+		{
+			return m_dirtyChunks.exchange(0, std::memory_order_relaxed);
+		}
+		
+		//Marks the chunks in a mask returned by ClearDirtyChunks as dirty again, for when saving them failed.
+		inline void MarkChunksDirty(uint32_t chunkMask) const
+		{
+			m_dirtyChunks.fetch_or(chunkMask, std::memory_order_relaxed);
+		}
+		
+		//Returns the number of bytes used by this region, including the block storage of all chunks.
+		size_t GetMemoryUsage() const;
 		
 		static constexpr int Size = 32;
 		static constexpr int Height = 256;
@@ -113,8 +272,12 @@ namespace MCR
 		static constexpr int BlockCount = Size * Size * Height;
 		static constexpr size_t DataBufferBytes = BlockCount * (sizeof(uint8_t) + sizeof(uint8_t));
 		
+		static_assert(ChunkStorage::Size == Size, "Chunk storage size mismatch.");
+		static_assert(ChunkCount <= 32, "Too many chunks for the dirty chunk mask.");
+		static_assert(ChunkMask::Size == Size, "Chunk mask size mismatch.");
+		
 	private:
-		inline static size_t GetBlockIndex(int locX, int locY, int locZ)
+		inline static void CheckBounds(int locX, int locY, int locZ)
 		{
 #ifdef MCR_DEBUG
 			if (locX < 0 || locY < 0 || locZ < 0 || locX >= static_cast<int>(Size) ||
@@ -123,13 +286,51 @@ namespace MCR
 				throw std::out_of_range("Chunk index out of range");
 			}
 #endif
-			return locX + (locZ + locY * Size) * Size;
 		}
 		
-		std::array<int, ChunkCount> m_opaquePerChunk;
-		std::array<int, ChunkCount> m_waterPerChunk;
+		//Returns the index of a block within its chunk, chunkY is the y coordinate relative to the chunk.
+		inline static uint32_t GetChunkBlockIndex(int locX, int chunkY, int locZ)
+		{
+			return static_cast<uint32_t>(locX + (locZ + chunkY * Size) * Size);
+		}
+		
+		//Reference implementation of CalculateConnectivity, which does a depth first search over individual blocks.
+		static ChunkConnectivity CalculateConnectivityReference(const Chunk& chunk);
+		
+		inline void MarkChunkDirty(int index)
+		{
+			m_dirtyChunks.fetch_or(1U << index, std::memory_order_relaxed);
+		}
+		
+		//Returns a chunk which can be written to, copying it first if it is shared with a snapshot.
+		Chunk& GetMutableChunk(uint32_t index);
+		
+		//Recalculates the opaque and water masks and counters of a chunk from its blocks.
+		static void UpdateChunkMasks(Chunk& chunk);
+		
+		static void FillChunk(Chunk& chunk, BlockEntry entry);
+		
+		//Returns the highest opaque or non air block at or below startY in a column, or -1 if there is none.
+		int FindMaxSolidY(int locX, int locZ, int startY) const;
+		int FindMaxNonAirY(int locX, int locZ, int startY) const;
+		
+		std::array<std::shared_ptr<Chunk>, ChunkCount> m_chunks;
+		
+		//Chunks which have had a snapshot taken of their current version.
+		mutable std::bitset<ChunkCount> m_snapshotTaken;
+		
+		//Bit i is set if chunk i has been modified since the region was loaded or last saved. This is modified by the
+		//thread saving the region as well as the thread owning it, see ClearDirtyChunks.
+		mutable std::atomic<uint32_t> m_dirtyChunks { 0 };
+		
+		//Chunks which have been written to by bulk writes since the last call to UpdateStaleChunks.
+		std::bitset<ChunkCount> m_staleChunks;
 		
-		std::array<BlockEntry, BlockCount> m_blocks;
+		//Height maps indexed by locX + locZ * Size, see GetMaxSolidY and GetMaxNonAirY.
+		std::array<int16_t, Size * Size> m_maxSolidY;
+		std::array<int16_t, Size * Size> m_maxNonAirY;
+		int m_regionMaxNonAirY = -1;
+		int m_regionMinSolidY = -1;
 		
 		int64_t m_coordX;
 		int64_t m_coordZ;
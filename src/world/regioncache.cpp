@@ -0,0 +1,75 @@
+#include "regioncache.h"
+
+namespace MCR
+{
+	RegionCache::RegionCache(size_t capacityBytes)
+	    : m_capacity(capacityBytes) { }
+	
+	void RegionCache::Insert(RegionCoordinate coordinate, std::vector<uint8_t> data)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		if (m_capacity.load(std::memory_order_relaxed) == 0)
+			return;
+		
+		auto entryIt = m_entryMap.find(coordinate);
+		if (entryIt != m_entryMap.end())
+		{
+			m_memoryUsage -= entryIt->second->m_data.size();
+			m_entries.erase(entryIt->second);
+			m_entryMap.erase(entryIt);
+		}
+		
+		m_memoryUsage += data.size();
+		m_entries.push_front({ coordinate, std::move(data) });
+		m_entryMap.emplace(coordinate, m_entries.begin());
+		
+		Evict();
+	}
+	
+	bool RegionCache::Take(RegionCoordinate coordinate, std::vector<uint8_t>& data)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		auto entryIt = m_entryMap.find(coordinate);
+		if (entryIt == m_entryMap.end())
+		{
+			m_misses++;
+			return false;
+		}
+		
+		m_hits++;
+		m_memoryUsage -= entryIt->second->m_data.size();
+		data = std::move(entryIt->second->m_data);
+		m_entries.erase(entryIt->second);
+		m_entryMap.erase(entryIt);
+		return true;
+	}
+	
+	void RegionCache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		m_entries.clear();
+		m_entryMap.clear();
+		m_memoryUsage = 0;
+	}
+	
+	void RegionCache::SetCapacity(size_t capacityBytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		m_capacity = capacityBytes;
+		Evict();
+	}
+	
+	void RegionCache::Evict()
+	{
+		while (!m_entries.empty() && m_memoryUsage > m_capacity)
+		{
+			m_memoryUsage -= m_entries.back().m_data.size();
+			m_entryMap.erase(m_entries.back().m_coordinate);
+			m_entries.pop_back();
+		}
+	}
+}
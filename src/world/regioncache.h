@@ -0,0 +1,76 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "region.h"
+
+namespace MCR
+{
+	//Keeps the serialized (compressed) data of regions which have left the loaded area, so that they can be restored
+	//without reading them from disk if the camera moves back. The least recently inserted regions are dropped once
+	//the total size of the cached data exceeds the capacity. All functions are thread safe.
+	class RegionCache
+	{
+	public:
+		explicit RegionCache(size_t capacityBytes = 0);
+		
+		//Replaces any cached data for the region.
+		void Insert(RegionCoordinate coordinate, std::vector<uint8_t> data);
+		
+		//Removes a region from the cache, moving its data to data. Returns false if the region isn't cached.
+		bool Take(RegionCoordinate coordinate, std::vector<uint8_t>& data);
+		
+		void Clear();
+		
+		//Sets the maximum number of bytes of region data to keep, a capacity of 0 disables the cache.
+		void SetCapacity(size_t capacityBytes);
+		
+		inline size_t GetCapacity() const
+		{
+			return m_capacity.load(std::memory_order_relaxed);
+		}
+		
+		//The number of bytes of region data currently cached.
+		inline size_t GetMemoryUsage() const
+		{
+			return m_memoryUsage.load(std::memory_order_relaxed);
+		}
+		
+		inline uint64_t GetHits() const
+		{
+			return m_hits.load(std::memory_order_relaxed);
+		}
+		
+		inline uint64_t GetMisses() const
+		{
+			return m_misses.load(std::memory_order_relaxed);
+		}
+		
+	private:
+		//Drops the oldest entries until the cached data fits in the capacity. The mutex must be held.
+		void Evict();
+		
+		struct Entry
+		{
+			RegionCoordinate m_coordinate;
+			std::vector<uint8_t> m_data;
+		};
+		
+		std::mutex m_mutex;
+		
+		//Entries ordered from most to least recently inserted.
+		std::list<Entry> m_entries;
+		std::unordered_map<RegionCoordinate, std::list<Entry>::iterator, RegionCoordinateHash> m_entryMap;
+		
+		std::atomic<size_t> m_capacity;
+		std::atomic<size_t> m_memoryUsage { 0 };
+		
+		std::atomic<uint64_t> m_hits { 0 };
+		std::atomic<uint64_t> m_misses { 0 };
+	};
+}
@@ -0,0 +1,333 @@
+#include "regioncontainer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__linux__)
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#elif defined(_WIN32)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#endif
+
+namespace MCR
+{
+	const char ContainerMagic[] = { 'M', 'C' };
+	const uint16_t ContainerVersion = 1;
+
+#pragma pack(push, 1)
+	struct ContainerHeader
+	{
+		char m_magic[sizeof(ContainerMagic)];
+		uint16_t m_version;
+		uint32_t m_slotCount;
+	};
+#pragma pack(pop)
+	
+	//The slot table follows the header, the region data starts at the first sector after the table.
+	const uint64_t SlotTableOffset = sizeof(ContainerHeader);
+	
+	static_assert(sizeof(ContainerHeader) + RegionContainer::SlotCount * 2 * sizeof(uint32_t) <=
+	              RegionContainer::SectorSize, "The slot table must fit in the first sector.");
+	
+	inline uint32_t GetSectorsForLength(uint64_t length)
+	{
+		return static_cast<uint32_t>((length + RegionContainer::SectorSize - 1) / RegionContainer::SectorSize);
+	}
+	
+	RegionContainer::RegionContainer(const fs::path& path, bool create)
+	    : m_path(path)
+	{
+		Open(create);
+	}
+	
+	RegionContainer::~RegionContainer()
+	{
+		Close();
+	}
+	
+	void RegionContainer::Open(bool create)
+	{
+		uint64_t fileSize;
+		
+#if defined(__linux__)
+		const int fd = open(m_path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+		if (fd == -1)
+		{
+			throw std::runtime_error("Error opening region container file '" + m_path.string() + "'.");
+		}
+		m_file = fd;
+		
+		struct stat fileStat;
+		fstat(fd, &fileStat);
+		fileSize = static_cast<uint64_t>(fileStat.st_size);
+#elif defined(_WIN32)
+		HANDLE handle = CreateFileW(m_path.wstring().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+		                            create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Error opening region container file '" + m_path.string() + "'.");
+		}
+		m_file = reinterpret_cast<intptr_t>(handle);
+		
+		LARGE_INTEGER largeFileSize;
+		GetFileSizeEx(handle, &largeFileSize);
+		fileSize = static_cast<uint64_t>(largeFileSize.QuadPart);
+#endif
+		
+		if (fileSize == 0)
+		{
+			ContainerHeader header;
+			std::copy(std::begin(ContainerMagic), std::end(ContainerMagic), header.m_magic);
+			header.m_version = ContainerVersion;
+			header.m_slotCount = SlotCount;
+			
+			std::memset(m_slots.data(), 0, sizeof(m_slots));
+			
+			WriteAt(0, &header, sizeof(header));
+			WriteAt(SlotTableOffset, m_slots.data(), sizeof(m_slots));
+			m_sectorCount = 1;
+			return;
+		}
+		
+		ContainerHeader header;
+		ReadAt(0, &header, sizeof(header));
+		if (std::memcmp(header.m_magic, ContainerMagic, sizeof(ContainerMagic)) != 0 ||
+		    header.m_slotCount != SlotCount)
+		{
+			throw std::runtime_error("Invalid region container file.");
+		}
+		
+		if (header.m_version != ContainerVersion)
+		{
+			throw std::runtime_error("Unsupported region container version number.");
+		}
+		
+		ReadAt(SlotTableOffset, m_slots.data(), sizeof(m_slots));
+		m_sectorCount = GetSectorsForLength(fileSize);
+		
+		for (const Slot& slot : m_slots)
+		{
+			if (slot.m_length != 0 && (slot.m_sector == 0 ||
+			    static_cast<uint64_t>(slot.m_sector) + GetSectorsForLength(slot.m_length) > m_sectorCount))
+			{
+				throw std::runtime_error("Invalid region container file.");
+			}
+		}
+	}
+	
+	void RegionContainer::Close()
+	{
+		if (m_file == -1)
+			return;
+			
+#if defined(__linux__)
+		close(static_cast<int>(m_file));
+#elif defined(_WIN32)
+		CloseHandle(reinterpret_cast<HANDLE>(m_file));
+#endif
+		m_file = -1;
+	}
+	
+	void RegionContainer::Flush()
+	{
+#if defined(__linux__)
+		if (fdatasync(static_cast<int>(m_file)) != 0)
+#elif defined(_WIN32)
+		if (!FlushFileBuffers(reinterpret_cast<HANDLE>(m_file)))
+#endif
+		{
+			throw std::runtime_error("Error flushing region container file.");
+		}
+	}
+	
+	//Makes a rename in a directory durable. Windows doesn't support opening directories for this.
+	static void FlushDirectory(const fs::path& path)
+	{
+#if defined(__linux__)
+		const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd == -1 || fsync(fd) != 0)
+		{
+			if (fd != -1)
+				close(fd);
+			throw std::runtime_error("Error flushing directory '" + path.string() + "'.");
+		}
+		close(fd);
+#endif
+	}
+	
+	void RegionContainer::ReadAt(uint64_t offset, void* data, size_t size) const
+	{
+		char* dataChars = reinterpret_cast<char*>(data);
+		
+		while (size > 0)
+		{
+#if defined(__linux__)
+			const ssize_t bytesRead = pread(static_cast<int>(m_file), dataChars, size, static_cast<off_t>(offset));
+			if (bytesRead <= 0)
+			{
+				throw std::runtime_error("Error reading region container file.");
+			}
+#elif defined(_WIN32)
+			OVERLAPPED overlapped = { };
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			
+			DWORD bytesRead;
+			if (!ReadFile(reinterpret_cast<HANDLE>(m_file), dataChars, static_cast<DWORD>(size), &bytesRead,
+			              &overlapped) || bytesRead == 0)
+			{
+				throw std::runtime_error("Error reading region container file.");
+			}
+#endif
+			
+			dataChars += bytesRead;
+			offset += static_cast<uint64_t>(bytesRead);
+			size -= static_cast<size_t>(bytesRead);
+		}
+	}
+	
+	void RegionContainer::WriteAt(uint64_t offset, const void* data, size_t size)
+	{
+		const char* dataChars = reinterpret_cast<const char*>(data);
+		
+		while (size > 0)
+		{
+#if defined(__linux__)
+			const ssize_t bytesWritten = pwrite(static_cast<int>(m_file), dataChars, size, static_cast<off_t>(offset));
+			if (bytesWritten <= 0)
+			{
+				throw std::runtime_error("Error writing region container file.");
+			}
+#elif defined(_WIN32)
+			OVERLAPPED overlapped = { };
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			
+			DWORD bytesWritten;
+			if (!WriteFile(reinterpret_cast<HANDLE>(m_file), dataChars, static_cast<DWORD>(size), &bytesWritten,
+			               &overlapped) || bytesWritten == 0)
+			{
+				throw std::runtime_error("Error writing region container file.");
+			}
+#endif
+			
+			dataChars += bytesWritten;
+			offset += static_cast<uint64_t>(bytesWritten);
+			size -= static_cast<size_t>(bytesWritten);
+		}
+	}
+	
+	bool RegionContainer::Read(uint32_t slot, std::vector<uint8_t>& data) const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		const Slot slotEntry = m_slots[slot];
+		lock.unlock();
+		
+		if (slotEntry.m_length == 0)
+			return false;
+		
+		data.resize(slotEntry.m_length);
+		ReadAt(static_cast<uint64_t>(slotEntry.m_sector) * SectorSize, data.data(), data.size());
+		return true;
+	}
+	
+	void RegionContainer::Write(uint32_t slot, gsl::span<const uint8_t> data)
+	{
+		if (data.empty() || data.size() > UINT32_MAX)
+		{
+			throw std::invalid_argument("Invalid region data size.");
+		}
+		
+		//The sectors are reserved before writing, so that other threads can write to other slots meanwhile.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		Slot newSlot;
+		newSlot.m_sector = m_sectorCount;
+		newSlot.m_length = static_cast<uint32_t>(data.size());
+		m_sectorCount += GetSectorsForLength(newSlot.m_length);
+		lock.unlock();
+		
+		//The data is written and flushed before the table entry, so the entry never points to partially written data,
+		//even if the table entry reaches the disk first.
+		WriteAt(static_cast<uint64_t>(newSlot.m_sector) * SectorSize, data.data(), data.size());
+		if (m_flushWrites)
+		{
+			Flush();
+		}
+		
+		lock.lock();
+		WriteAt(SlotTableOffset + slot * sizeof(Slot), &newSlot, sizeof(Slot));
+		m_slots[slot] = newSlot;
+	}
+	
+	bool RegionContainer::GetDataLocation(uint32_t slot, DataLocation& location) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		if (m_slots[slot].m_length == 0)
+			return false;
+		
+		location.m_offset = static_cast<uint64_t>(m_slots[slot].m_sector) * SectorSize;
+		location.m_length = m_slots[slot].m_length;
+		return true;
+	}
+	
+	void RegionContainer::DropPageCache()
+	{
+#if defined(__linux__)
+		fdatasync(static_cast<int>(m_file));
+		posix_fadvise(static_cast<int>(m_file), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	}
+	
+	uint32_t RegionContainer::GetUnusedSectors() const
+	{
+		uint32_t usedSectors = 1;
+		for (const Slot& slot : m_slots)
+		{
+			usedSectors += GetSectorsForLength(slot.m_length);
+		}
+		return m_sectorCount - usedSectors;
+	}
+	
+	void RegionContainer::Compact()
+	{
+		fs::path compactPath = m_path;
+		compactPath += ".compact";
+		fs::remove(compactPath);
+		
+		{
+			RegionContainer compactContainer(compactPath);
+			compactContainer.m_flushWrites = false;
+			
+			std::vector<uint8_t> data;
+			ForEachRegion([&] (uint32_t slot)
+			{
+				Read(slot, data);
+				compactContainer.Write(slot, data);
+			});
+			
+			compactContainer.Flush();
+		}
+		
+		//The compacted file replaces the original only once it is complete and on disk. The original is reopened
+		//if the rename fails, and the handle stays closed (failing reads and writes) if opening fails.
+		Close();
+		std::error_code renameError;
+		fs::rename(compactPath, m_path, renameError);
+		Open(false);
+		
+		if (renameError)
+		{
+			throw fs::filesystem_error("Error replacing region container file.", compactPath, m_path, renameError);
+		}
+		FlushDirectory(m_path.parent_path());
+	}
+}
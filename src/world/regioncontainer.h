@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <gsl/span>
+
+#include "region.h"
+#include "../filesystem.h"
+
+namespace MCR
+{
+	//A file storing the serialized data of a square of regions. The file starts with a table holding the location of
+	//each region's data, which is stored in a contiguous run of sectors. Sectors are only ever appended, a region which
+	//is saved again is written to the end of the file and flushed to disk before its table entry is updated, so a save
+	//interrupted by a crash or power loss leaves the previous data intact. The sectors left behind are reclaimed by
+	//Compact.
+	//Read and Write can be called from multiple threads at once, as long as each slot is only written to by one
+	//thread at a time. The other functions must not be called concurrently with Write.
+	class RegionContainer
+	{
+	public:
+		//Opens the container file at path. If create is true the file is created if it doesn't exist, otherwise a
+		//missing file is an error.
+		explicit RegionContainer(const fs::path& path, bool create = true);
+		~RegionContainer();
+		
+		RegionContainer(const RegionContainer& other) = delete;
+		RegionContainer& operator=(const RegionContainer& other) = delete;
+		
+		inline bool HasRegion(uint32_t slot) const
+		{
+			return m_slots[slot].m_length != 0;
+		}
+		
+		//Reads the data of the region in a slot with a single read, returns false if the slot is empty.
+		bool Read(uint32_t slot, std::vector<uint8_t>& data) const;
+		
+		void Write(uint32_t slot, gsl::span<const uint8_t> data);
+		
+		//The location of a region's data in the file, for reading it without going through Read.
+		struct DataLocation
+		{
+			uint64_t m_offset;
+			uint32_t m_length;
+		};
+		
+		//Returns false if the slot is empty.
+		bool GetDataLocation(uint32_t slot, DataLocation& location) const;
+		
+		//The file descriptor on Linux, or the file handle on Windows.
+		inline intptr_t GetFileHandle() const
+		{
+			return m_file;
+		}
+		
+		//Writes the file to disk and asks the OS to drop it from the page cache, so that the next reads of it are
+		//cold. Only implemented on Linux, used for benchmarking.
+		void DropPageCache();
+		
+		//Rewrites the file with the regions packed together, dropping sectors which are no longer referenced. The
+		//compacted file is flushed to disk before it replaces the original.
+		void Compact();
+		
+		//Returns the number of sectors in the file which don't hold the current data of any region.
+		uint32_t GetUnusedSectors() const;
+		
+		inline uint64_t GetFileSize() const
+		{
+			return static_cast<uint64_t>(m_sectorCount) * SectorSize;
+		}
+		
+		template <typename CallbackTp>
+		void ForEachRegion(CallbackTp callback) const
+		{
+			for (uint32_t slot = 0; slot < SlotCount; slot++)
+			{
+				if (HasRegion(slot))
+					callback(slot);
+			}
+		}
+		
+		//Returns the coordinate of the container holding a region.
+		inline static RegionCoordinate GetContainerCoordinate(int64_t regionX, int64_t regionZ)
+		{
+			return { FloorDiv(regionX), FloorDiv(regionZ) };
+		}
+		
+		//Returns the slot of a region within its container.
+		inline static uint32_t GetSlot(int64_t regionX, int64_t regionZ)
+		{
+			return static_cast<uint32_t>((regionX - FloorDiv(regionX) * RegionsPerSide) +
+			                             (regionZ - FloorDiv(regionZ) * RegionsPerSide) * RegionsPerSide);
+		}
+		
+		//Returns the coordinate of the region in a slot of the container at the given coordinate.
+		inline static RegionCoordinate GetRegionCoordinate(RegionCoordinate container, uint32_t slot)
+		{
+			return {
+				container.x * RegionsPerSide + static_cast<int64_t>(slot) % RegionsPerSide,
+				container.z * RegionsPerSide + static_cast<int64_t>(slot) / RegionsPerSide
+			};
+		}
+		
+		static constexpr int64_t RegionsPerSide = 16;
+		static constexpr uint32_t SlotCount = RegionsPerSide * RegionsPerSide;
+		static constexpr uint32_t SectorSize = 4096;
+		
+	private:
+		inline static int64_t FloorDiv(int64_t coordinate)
+		{
+			return (coordinate >= 0 ? coordinate : coordinate - (RegionsPerSide - 1)) / RegionsPerSide;
+		}
+		
+		void Open(bool create);
+		void Close();
+		
+		//Waits for the data written to the file to reach the disk.
+		void Flush();
+		
+		void ReadAt(uint64_t offset, void* data, size_t size) const;
+		void WriteAt(uint64_t offset, const void* data, size_t size);
+		
+		struct Slot
+		{
+			uint32_t m_sector;
+			uint32_t m_length;
+		};
+		
+		fs::path m_path;
+		intptr_t m_file = -1;
+		
+		//Whether Write flushes the data before updating the table entry. Not needed while compacting, since the
+		//compacted file is flushed once before it replaces the original.
+		bool m_flushWrites = true;
+		
+		//Protects the sector count and slot table, but not the file itself.
+		mutable std::mutex m_mutex;
+		
+		uint32_t m_sectorCount;
+		std::array<Slot, SlotCount> m_slots;
+	};
+}
@@ -1,8 +1,13 @@
 #include "regiongeneratethread.h"
+#include "regionpool.h"
+#include "worldmanager.h"
+
+#include <chrono>
 
 namespace MCR
 {
-	RegionGenerateThread::RegionGenerateThread(size_t numThreads)
+	RegionGenerateThread::RegionGenerateThread(size_t numThreads, RegionPool& regionPool)
+	    : m_regionPool(regionPool)
 	{
 		for (size_t i = 0; i < numThreads; i++)
 		{
@@ -36,51 +41,299 @@ namespace MCR
 		}
 	}
 	
-	void RegionGenerateThread::ThreadTarget()
+	RegionGenerateThread::CancelToken RegionGenerateThread::Register(RegionCoordinate coordinate)
 	{
-		while (true)
+		CancelToken cancelToken = std::make_shared<std::atomic<bool>>(false);
+		Enqueue(m_regionsToGenerate, coordinate, cancelToken);
+		return cancelToken;
+	}
+	
+	void RegionGenerateThread::RegisterPrefetch(RegionCoordinate coordinate)
+	{
+		Enqueue(m_regionsToPrefetch, coordinate, nullptr);
+	}
+	
+	RegionGenerateThread::CancelToken RegionGenerateThread::PromotePrefetch(RegionCoordinate coordinate)
+	{
+		auto prefetchIt = std::find_if(MAKE_RANGE(m_regionsToPrefetch), [&] (const QueuedRegion& region)
+		{
+			return region.m_coordinate == coordinate;
+		});
+		if (prefetchIt == m_regionsToPrefetch.end())
+			return nullptr;
+		
+		m_regionsToPrefetch.erase(prefetchIt);
+		std::make_heap(MAKE_RANGE(m_regionsToPrefetch), IsFurther);
+		
+		return Register(coordinate);
+	}
+	
+	void RegionGenerateThread::SetCameraRegion(RegionCoordinate coordinate)
+	{
+		if (coordinate == m_cameraRegion)
+			return;
+		m_cameraRegion = coordinate;
+		
+		for (std::vector<QueuedRegion>* queue : { &m_regionsToGenerate, &m_regionsToPrefetch })
 		{
-			std::unique_lock<std::mutex> inputLock(m_inputMutex);
+			auto newEnd = std::remove_if(queue->begin(), queue->end(), [&] (const QueuedRegion& region)
+			{
+				return IsCancelled(region.m_cancelToken);
+			});
 			
-			m_signal.wait(inputLock, [&] { return !m_regionsToGenerate.empty() || m_exit; });
+			m_numCancelled.fetch_add(queue->end() - newEnd, std::memory_order_relaxed);
+			queue->erase(newEnd, queue->end());
 			
-			if (m_exit)
-				break;
+			for (QueuedRegion& region : *queue)
+			{
+				region.m_distanceSq = RegionCoordinate::DistanceSq(region.m_coordinate, coordinate);
+			}
+			std::make_heap(queue->begin(), queue->end(), IsFurther);
+		}
+		
+		UpdateNumPending();
+	}
+	
+	void RegionGenerateThread::Enqueue(std::vector<QueuedRegion>& queue, RegionCoordinate coordinate,
+	                                   CancelToken cancelToken)
+	{
+		const uint64_t distanceSq = RegionCoordinate::DistanceSq(coordinate, m_cameraRegion);
+		queue.push_back({ coordinate, distanceSq, std::move(cancelToken) });
+		std::push_heap(queue.begin(), queue.end(), IsFurther);
+		
+		m_anyEnqueued = true;
+		UpdateNumPending();
+	}
+	
+	bool RegionGenerateThread::PopClosest(std::vector<QueuedRegion>& queue, QueuedRegion& region)
+	{
+		while (!queue.empty())
+		{
+			std::pop_heap(queue.begin(), queue.end(), IsFurther);
+			region = std::move(queue.back());
+			queue.pop_back();
+			UpdateNumPending();
+			
+			if (!IsCancelled(region.m_cancelToken))
+				return true;
+			
+			m_numCancelled.fetch_add(1, std::memory_order_relaxed);
+		}
+		
+		return false;
+	}
+	
+	void RegionGenerateThread::ProcessFutureRegions(WorldManager& worldManager)
+	{
+		auto getRegion = [&] (RegionCoordinate coordinate)
+		{
+			return worldManager.GetRegion(coordinate);
+		};
+		
+		m_generator.ProcessFutureRegions(getRegion, [&] (RegionCoordinate coordinate)
+		{
+			const glm::ivec2 neighbors[] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+			
+			for (uint32_t y = 0; y < Region::ChunkCount; y++)
+			{
+				worldManager.MarkOutOfDate(coordinate, y);
+				
+				for (glm::ivec2 neighbor : neighbors)
+				{
+					worldManager.MarkOutOfDate({ coordinate.x + neighbor.x, coordinate.z + neighbor.y }, y);
+				}
+			}
+		});
+	}
+	
+	void RegionGenerateThread::BenchmarkFirstRing(size_t numThreads)
+	{
+		using Clock = std::chrono::steady_clock;
+		using Milliseconds = std::chrono::duration<double, std::milli>;
+		
+		//Regions are generated within this distance from the camera, like when a world has just been loaded.
+		const int64_t loadDistance = 4;
+		const size_t numRegions = (loadDistance * 2 + 1) * (loadDistance * 2 + 1);
+		
+		for (bool splitRegions : { false, true })
+		{
+			RegionPool regionPool;
+			RegionGenerateThread generateThread(numThreads, regionPool);
+			generateThread.SetSplitRegions(splitRegions);
+			
+			const Clock::time_point startTime = Clock::now();
 			
-			//Selects the closest region to the camera for generation.
-			long selectedIndex = -1;
-			uint64_t selectedRegionDistFromCamera = 0;
-			for (size_t i = 0; i < m_regionsToGenerate.size(); i++)
+			generateThread.BeginRegistering();
+			generateThread.SetCameraRegion({ 0, 0 });
+			for (int64_t z = -loadDistance; z <= loadDistance; z++)
 			{
-				uint64_t distFromCamera = RegionCoordinate::DistanceSq(m_regionsToGenerate[i], m_cameraRegion);
-				if (selectedRegionDistFromCamera > distFromCamera || selectedIndex == -1)
+				for (int64_t x = -loadDistance; x <= loadDistance; x++)
 				{
-					selectedIndex = i;
-					selectedRegionDistFromCamera = distFromCamera;
+					generateThread.Register({ x, z });
 				}
 			}
+			generateThread.EndRegistering();
 			
-			RegionCoordinate regionCoord = m_regionsToGenerate[selectedIndex];
-			m_regionsToGenerate[selectedIndex] = m_regionsToGenerate.back();
-			m_regionsToGenerate.pop_back();
+			size_t numGenerated = 0;
+			uint32_t numFirstRingGenerated = 0;
+			Clock::duration firstRingTime { };
 			
-			inputLock.unlock();
+			while (numGenerated < numRegions)
+			{
+				generateThread.IterateGeneratedRegions([&] (NewRegion& newRegion)
+				{
+					numGenerated++;
+					
+					if (std::abs(newRegion.m_region->GetX()) <= 1 && std::abs(newRegion.m_region->GetZ()) <= 1 &&
+					    ++numFirstRingGenerated == 9)
+					{
+						firstRingTime = Clock::now() - startTime;
+					}
+				});
+				
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			
+			const Clock::duration totalTime = Clock::now() - startTime;
+			
+			Log(splitRegions ? "Split regions" : "Whole regions", " with ", numThreads, " threads: first ring ",
+			    std::chrono::duration_cast<Milliseconds>(firstRingTime).count(), "ms, all ", numRegions, " regions ",
+			    std::chrono::duration_cast<Milliseconds>(totalTime).count(), "ms");
+		}
+	}
+	
+	bool RegionGenerateThread::GenerateActiveRegionTile(std::unique_lock<std::mutex>& inputLock)
+	{
+		if (m_numTilesWaiting == 0)
+			return false;
+		
+		auto activeRegionIt = std::find_if(MAKE_RANGE(m_activeRegions), [&] (const ActiveRegion& activeRegion)
+		{
+			return activeRegion.m_nextTile != WorldGenerator::GenerateJob::NumTiles;
+		});
+		
+		//Drops the tiles of a cancelled region which haven't been started. The region is discarded once the tiles
+		//which have been started are done.
+		if (IsCancelled(activeRegionIt->m_cancelToken))
+		{
+			const uint32_t numDroppedTiles = WorldGenerator::GenerateJob::NumTiles - activeRegionIt->m_nextTile;
+			activeRegionIt->m_nextTile = WorldGenerator::GenerateJob::NumTiles;
+			activeRegionIt->m_tilesLeft -= numDroppedTiles;
+			activeRegionIt->m_cancelled = true;
+			m_numTilesWaiting -= numDroppedTiles;
+			m_numCancelled.fetch_add(1, std::memory_order_relaxed);
 			
+			if (activeRegionIt->m_tilesLeft == 0)
+			{
+				m_activeRegions.erase(activeRegionIt);
+			}
+			return true;
+		}
+		
+		const uint32_t tileIndex = activeRegionIt->m_nextTile++;
+		m_numTilesWaiting--;
+		
+		inputLock.unlock();
+		m_generator.GenerateTile(*activeRegionIt->m_job, tileIndex);
+		inputLock.lock();
+		
+		//The thread which generates the last tile finishes the region.
+		if (--activeRegionIt->m_tilesLeft != 0)
+			return true;
+		
+		if (activeRegionIt->m_cancelled)
+		{
+			m_activeRegions.erase(activeRegionIt);
+			return true;
+		}
+		
+		ActiveRegion activeRegion = std::move(*activeRegionIt);
+		m_activeRegions.erase(activeRegionIt);
+		
+		inputLock.unlock();
+		
+		m_generator.FinishGenerate(*activeRegion.m_job);
+		FinishRegion(std::move(activeRegion.m_newRegion));
+		
+		inputLock.lock();
+		return true;
+	}
+	
+	void RegionGenerateThread::FinishRegion(NewRegion newRegion)
+	{
+		newRegion.m_region->Compact();
+		
 #ifdef MCR_REGION_LOG
-			Log("Generating (", regionCoord.x, ", ", regionCoord.z, ")");
+		Log("Generated (", newRegion.m_region->GetX(), ", ", newRegion.m_region->GetZ(), ")");
 #endif
+		
+		std::lock_guard<std::mutex> outputLock(m_outputMutex);
+		
+		m_generatedRegions.push_back(std::move(newRegion));
+	}
+	
+	void RegionGenerateThread::ThreadTarget()
+	{
+		std::unique_lock<std::mutex> inputLock(m_inputMutex);
+		
+		while (true)
+		{
+			m_signal.wait(inputLock, [&]
+			{
+				return !m_regionsToGenerate.empty() || !m_regionsToPrefetch.empty() || m_numTilesWaiting != 0 || m_exit;
+			});
+			
+			if (m_exit)
+				break;
 			
-			NewRegion newRegion(std::make_shared<Region>(regionCoord.x, regionCoord.z));
+			//Helps with regions which have already been started before starting new ones, since these were closer
+			//to the camera when they were selected.
+			if (GenerateActiveRegionTile(inputLock))
+				continue;
 			
-			m_generator.Generate(*newRegion.m_region);
+			//Prefetches are only generated once there are no other regions waiting.
+			QueuedRegion queuedRegion;
+			if (!PopClosest(m_regionsToGenerate, queuedRegion) && !PopClosest(m_regionsToPrefetch, queuedRegion))
+				continue;
+			
+			const RegionCoordinate regionCoord = queuedRegion.m_coordinate;
+			
+			inputLock.unlock();
 			
 #ifdef MCR_REGION_LOG
-			Log("Generated (", regionCoord.x, ", ", regionCoord.z, ")");
+			Log("Generating (", regionCoord.x, ", ", regionCoord.z, ")");
 #endif
 			
-			std::lock_guard<std::mutex> outputLock(m_outputMutex);
+			NewRegion newRegion(m_regionPool.Acquire(regionCoord.x, regionCoord.z));
+			
+			if (!m_splitRegions)
+			{
+				m_generator.Generate(*newRegion.m_region);
+				
+				//Regions cancelled while being generated are discarded, like in the split path.
+				if (IsCancelled(queuedRegion.m_cancelToken))
+				{
+					m_numCancelled.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					FinishRegion(std::move(newRegion));
+				}
+				
+				inputLock.lock();
+				continue;
+			}
+			
+			ActiveRegion activeRegion;
+			activeRegion.m_job = m_generator.BeginGenerate(*newRegion.m_region);
+			activeRegion.m_newRegion = std::move(newRegion);
+			activeRegion.m_cancelToken = std::move(queuedRegion.m_cancelToken);
+			
+			inputLock.lock();
 			
-			m_generatedRegions.push_back(std::move(newRegion));
+			m_activeRegions.push_back(std::move(activeRegion));
+			m_numTilesWaiting += WorldGenerator::GenerateJob::NumTiles;
+			m_signal.notify_all();
 		}
 	}
 }
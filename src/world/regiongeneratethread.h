@@ -3,7 +3,9 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <list>
+#include <atomic>
+#include <memory>
 
 #include "region.h"
 #include "worldgenerator.h"
@@ -14,7 +16,7 @@ namespace MCR
 	class RegionGenerateThread final
 	{
 	public:
-		explicit RegionGenerateThread(size_t numThreads);
+		RegionGenerateThread(size_t numThreads, class RegionPool& regionPool);
 		~RegionGenerateThread();
 		
 		inline void BeginRegistering()
@@ -25,17 +27,37 @@ namespace MCR
 		
 		void EndRegistering();
 		
-		//Only call between BeginRegistering and EndRegistering.
-		inline void Register(RegionCoordinate coordinate)
+		//Set to true to cancel generation of a registered region. A region which is being generated is discarded once
+		//the tiles which have been started are done.
+		using CancelToken = std::shared_ptr<std::atomic<bool>>;
+		
+		//Returns a token which cancels generation of the region. Only call between BeginRegistering and
+		//EndRegistering.
+		CancelToken Register(RegionCoordinate coordinate);
+		
+		//Generates a region which is expected to enter the loaded area soon, once no other regions are waiting to be
+		//generated. Only call between BeginRegistering and EndRegistering.
+		void RegisterPrefetch(RegionCoordinate coordinate);
+		
+		//Moves a prefetch which hasn't started into the regular queue, for when the region has entered the loaded
+		//area. Returns a token which cancels generation of the region, or null if the region isn't waiting to be
+		//prefetched. Only call between BeginRegistering and EndRegistering.
+		CancelToken PromotePrefetch(RegionCoordinate coordinate);
+		
+		//Regions are generated in order of distance from the camera region. Changing it reorders the waiting regions
+		//and drops the ones which have been cancelled. Only call between BeginRegistering and EndRegistering.
+		void SetCameraRegion(RegionCoordinate coordinate);
+		
+		//The number of regions waiting to be generated, including prefetches. Can be called at any time.
+		inline size_t GetNumPending() const
 		{
-			m_regionsToGenerate.push_back(coordinate);
-			m_anyEnqueued = true;
+			return m_numPending.load(std::memory_order_relaxed);
 		}
 		
-		//Only call between BeginRegistering and EndRegistering.
-		inline void SetCameraRegion(RegionCoordinate coordinate)
+		//The number of regions which were cancelled before being generated.
+		inline uint64_t GetNumCancelled() const
 		{
-			m_cameraRegion = coordinate;
+			return m_numCancelled.load(std::memory_order_relaxed);
 		}
 		
 		template <typename CallbackTp>
@@ -55,25 +77,104 @@ namespace MCR
 			return true;
 		}
 		
-		inline void ProcessFutureRegions(class WorldManager& worldManager)
+		//Applies future block placements to the world manager's loaded regions, and marks their chunks out of date.
+		void ProcessFutureRegions(class WorldManager& worldManager);
+		
+		inline WorldGenerator& GetGenerator()
+		{
+			return m_generator;
+		}
+		
+		//Splits generation of each region into tiles which idle threads help with, so that the regions closest to the
+		//camera are finished by all threads instead of one. Can be changed while regions are being generated.
+		inline void SetSplitRegions(bool splitRegions)
 		{
-			m_generator.ProcessFutureRegions(worldManager);
+			m_splitRegions = splitRegions;
 		}
 		
+		inline bool IsSplittingRegions() const
+		{
+			return m_splitRegions;
+		}
+		
+		//Generates the regions around a camera with and without splitting regions, and logs the time taken until the
+		//camera's region and its neighbors have been generated, and until all regions have been generated.
+		static void BenchmarkFirstRing(size_t numThreads);
+		
 	private:
 		void ThreadTarget();
 		
+		struct QueuedRegion
+		{
+			RegionCoordinate m_coordinate;
+			uint64_t m_distanceSq;
+			CancelToken m_cancelToken;
+		};
+		
+		//Orders the queues as binary heaps with the region closest to the camera at the front.
+		static inline bool IsFurther(const QueuedRegion& a, const QueuedRegion& b)
+		{
+			return a.m_distanceSq > b.m_distanceSq;
+		}
+		
+		static inline bool IsCancelled(const CancelToken& cancelToken)
+		{
+			return cancelToken != nullptr && cancelToken->load(std::memory_order_relaxed);
+		}
+		
+		void Enqueue(std::vector<QueuedRegion>& queue, RegionCoordinate coordinate, CancelToken cancelToken);
+		
+		//Removes the closest region which hasn't been cancelled from a queue. Returns false if the queue has no such
+		//region. The input mutex must be held.
+		bool PopClosest(std::vector<QueuedRegion>& queue, QueuedRegion& region);
+		
+		inline void UpdateNumPending()
+		{
+			m_numPending = m_regionsToGenerate.size() + m_regionsToPrefetch.size();
+		}
+		
+		//A region which is being generated in tiles.
+		struct ActiveRegion
+		{
+			NewRegion m_newRegion;
+			std::unique_ptr<WorldGenerator::GenerateJob> m_job;
+			CancelToken m_cancelToken;
+			bool m_cancelled = false;
+			
+			uint32_t m_nextTile = 0;
+			uint32_t m_tilesLeft = WorldGenerator::GenerateJob::NumTiles;
+		};
+		
+		//Generates a tile of the region which started generating first. The input mutex must be held by inputLock,
+		//and is unlocked and locked again. Returns false if no tiles are waiting.
+		bool GenerateActiveRegionTile(std::unique_lock<std::mutex>& inputLock);
+		
+		void FinishRegion(NewRegion newRegion);
+		
 		WorldGenerator m_generator;
 		
+		class RegionPool& m_regionPool;
+		
 		std::mutex m_inputMutex;
 		std::mutex m_outputMutex;
 		
 		bool m_anyEnqueued = false;
 		bool m_exit = false;
 		
-		RegionCoordinate m_cameraRegion;
+		RegionCoordinate m_cameraRegion { 0, 0 };
+		
+		//Binary heaps ordered by IsFurther.
+		std::vector<QueuedRegion> m_regionsToGenerate;
+		std::vector<QueuedRegion> m_regionsToPrefetch;
+		
+		std::atomic<size_t> m_numPending { 0 };
+		std::atomic<uint64_t> m_numCancelled { 0 };
+		
+		//Regions with tiles which haven't been generated yet, in the order they were started.
+		std::list<ActiveRegion> m_activeRegions;
+		uint32_t m_numTilesWaiting = 0;
 		
-		std::vector<RegionCoordinate> m_regionsToGenerate;
+		std::atomic<bool> m_splitRegions { true };
 		
 		std::condition_variable m_signal;
 		
@@ -0,0 +1,29 @@
+#include "regionindex.h"
+
+namespace MCR
+{
+	bool RegionIndex::Contains(RegionCoordinate coordinate) const
+	{
+		const Shard& shard = GetShard(coordinate);
+		std::lock_guard<std::mutex> lock(shard.m_mutex);
+		return shard.m_coordinates.count(coordinate) != 0;
+	}
+	
+	bool RegionIndex::Insert(RegionCoordinate coordinate)
+	{
+		Shard& shard = GetShard(coordinate);
+		std::lock_guard<std::mutex> lock(shard.m_mutex);
+		return shard.m_coordinates.insert(coordinate).second;
+	}
+	
+	size_t RegionIndex::GetSize() const
+	{
+		size_t size = 0;
+		for (const Shard& shard : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.m_mutex);
+			size += shard.m_coordinates.size();
+		}
+		return size;
+	}
+}
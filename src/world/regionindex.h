@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <unordered_set>
+#include <cstdint>
+
+#include "region.h"
+
+namespace MCR
+{
+	//Set of region coordinates which can be queried and added to from multiple threads. The set is split into shards
+	//with their own locks, so lookups only contend with inserts which land in the same shard.
+	class RegionIndex
+	{
+	public:
+		bool Contains(RegionCoordinate coordinate) const;
+		
+		//Adds a coordinate to the index, returns false if it was already present.
+		bool Insert(RegionCoordinate coordinate);
+		
+		size_t GetSize() const;
+		
+	private:
+		static constexpr size_t ShardCount = 16;
+		
+		struct Shard
+		{
+			mutable std::mutex m_mutex;
+			std::unordered_set<RegionCoordinate, RegionCoordinateHash> m_coordinates;
+		};
+		
+		inline const Shard& GetShard(RegionCoordinate coordinate) const
+		{
+			return m_shards[(RegionCoordinateHash()(coordinate) >> 8) % ShardCount];
+		}
+		
+		inline Shard& GetShard(RegionCoordinate coordinate)
+		{
+			return m_shards[(RegionCoordinateHash()(coordinate) >> 8) % ShardCount];
+		}
+		
+		std::array<Shard, ShardCount> m_shards;
+	};
+}
@@ -1,10 +1,39 @@
 #include "regioniothread.h"
 #include "world.h"
+#include "regionpool.h"
+#include "regioncache.h"
+#include "regionreadring.h"
+#include "../arguments.h"
+
+#include <algorithm>
+#include <iterator>
 
 namespace MCR
 {
-	RegionIOThread::RegionIOThread(World& world)
-	    : m_world(world), m_thread(&RegionIOThread::ThreadTarget, this) { }
+	RegionIOThread::RegionIOThread(size_t numThreads, World& world, RegionPool& regionPool, RegionCache& regionCache)
+	    : m_world(world), m_regionPool(regionPool), m_regionCache(regionCache)
+	{
+		if (!Arguments::noIOUring)
+		{
+			m_readRing = RegionReadRing::Create(ReadRingEntries);
+		}
+		
+		for (size_t i = 0; i < numThreads; i++)
+		{
+			m_threads.emplace_back(&RegionIOThread::ThreadTarget, this);
+			
+			SetThreadDesc(m_threads.back().get_id(), "RegionIO" + std::to_string(i));
+		}
+		
+		if (m_readRing)
+		{
+			Log("Reading regions through io_uring.");
+			m_useReadRing = true;
+			
+			m_threads.emplace_back(&RegionIOThread::ReadRingThreadTarget, this);
+			SetThreadDesc(m_threads.back().get_id(), "RegionIORing");
+		}
+	}
 	
 	RegionIOThread::~RegionIOThread()
 	{
@@ -13,19 +42,22 @@ namespace MCR
 			m_exit = true;
 		}
 		
-		m_taskAvailableSignal.notify_one();
-		m_thread.join();
+		m_taskAvailableSignal.notify_all();
+		for (std::thread& thread : m_threads)
+		{
+			thread.join();
+		}
 	}
 	
 	void RegionIOThread::WaitIdle()
 	{
-		Log("Waiting for IO thread to finish.");
+		Log("Waiting for IO threads to finish.");
 		
 		std::unique_lock<std::mutex> lock(m_inputMutex);
 		
-		m_idleSignal.wait(lock, [&] { return m_idle; });
+		m_idleSignal.wait(lock, [&] { return IsIdle(); });
 		
-		Log("IO thread finished.");
+		Log("IO threads finished.");
 	}
 	
 	void RegionIOThread::BeginRegistering()
@@ -36,62 +68,224 @@ namespace MCR
 	
 	void RegionIOThread::EndRegistering()
 	{
-		if (m_anyEnqueued && m_idle)
+		UpdateQueueCounts();
+		
+		m_inputMutex.unlock();
+		
+		if (m_anyEnqueued)
+		{
+			m_taskAvailableSignal.notify_all();
+		}
+	}
+	
+	void RegionIOThread::RegisterForSaving(std::shared_ptr<const Region> region, bool evicted)
+	{
+		const RegionCoordinate coordinate = { region->GetX(), region->GetZ() };
+		
+		InFlightRegion& inFlightRegion = m_inFlightRegions[coordinate];
+		inFlightRegion.m_region = std::move(region);
+		inFlightRegion.m_evicted |= evicted;
+		
+		if (inFlightRegion.m_saveQueued)
 		{
-			m_taskAvailableSignal.notify_one();
-			m_idle = false;
+			m_numMergedSaves.fetch_add(1, std::memory_order_relaxed);
+			return;
 		}
 		
-		m_inputMutex.unlock();
+		//Regions which are being saved are queued again by the saving thread once it is done.
+		inFlightRegion.m_saveQueued = true;
+		if (!inFlightRegion.m_saving)
+		{
+			m_regionsToSave.push(coordinate);
+		}
+		m_anyEnqueued = true;
+	}
+	
+	void RegionIOThread::RegisterForLoading(RegionCoordinate coordinate)
+	{
+		auto inFlightIt = m_inFlightRegions.find(coordinate);
+		if (inFlightIt == m_inFlightRegions.end())
+		{
+			m_regionsToLoad.push_back(coordinate);
+			m_anyEnqueued = true;
+			return;
+		}
+		
+		//The region is returned without saving it if the save hasn't started. It is still marked as dirty, so it
+		//will be saved when it is evicted again.
+		m_numInFlightLoads.fetch_add(1, std::memory_order_relaxed);
+		if (inFlightIt->second.m_saving)
+		{
+			inFlightIt->second.m_loadRequested = true;
+		}
+		else
+		{
+			ReturnInFlightRegion(coordinate);
+		}
+	}
+	
+	void RegionIOThread::RegisterForPrefetching(RegionCoordinate coordinate)
+	{
+		if (m_inFlightRegions.count(coordinate) != 0)
+		{
+			RegisterForLoading(coordinate);
+			return;
+		}
+		
+		m_regionsToPrefetch.push_back(coordinate);
+		m_anyEnqueued = true;
+	}
+	
+	bool RegionIOThread::PromotePrefetch(RegionCoordinate coordinate)
+	{
+		auto prefetchIt = std::find(MAKE_RANGE(m_regionsToPrefetch), coordinate);
+		if (prefetchIt == m_regionsToPrefetch.end())
+			return false;
+		
+		*prefetchIt = m_regionsToPrefetch.back();
+		m_regionsToPrefetch.pop_back();
+		
+		m_regionsToLoad.push_back(coordinate);
+		m_anyEnqueued = true;
+		return true;
+	}
+	
+	void RegionIOThread::ReturnInFlightRegion(RegionCoordinate coordinate)
+	{
+		auto inFlightIt = m_inFlightRegions.find(coordinate);
+		
+		//The world manager was the only owner of the region before registering it for saving, so it can be given
+		//back as a mutable region.
+		{
+			std::lock_guard<std::mutex> lock(m_outputMutex);
+			m_loadedRegions.emplace_back(std::const_pointer_cast<Region>(std::move(inFlightIt->second.m_region)));
+		}
+		
+		m_inFlightRegions.erase(inFlightIt);
+	}
+	
+	void RegionIOThread::SetLoadArea(RegionCoordinate cameraRegion, int loadDistance)
+	{
+		m_cameraRegion = cameraRegion;
+		m_loadDistance = loadDistance;
+		
+		//Drops loads for regions which have left the load area, so that they aren't loaded twice if they enter it again
+		//before being loaded.
+		auto newEnd = std::remove_if(MAKE_RANGE(m_regionsToLoad), [&] (RegionCoordinate coordinate)
+		{
+			return !IsInLoadArea(coordinate);
+		});
+		
+		m_numCancelledLoads.fetch_add(m_regionsToLoad.end() - newEnd, std::memory_order_relaxed);
+		m_regionsToLoad.erase(newEnd, m_regionsToLoad.end());
 	}
 	
 	void RegionIOThread::ThreadTarget()
 	{
-		SetThreadDesc(std::this_thread::get_id(), "RegionIO");
+		std::vector<uint8_t> regionData;
 		
 		while (true)
 		{
 			std::unique_lock<std::mutex> lock(m_inputMutex);
 			
-			while (m_regionsToSave.empty() && m_regionsToLoad.empty() && !m_exit)
+			m_taskAvailableSignal.wait(lock, [&]
 			{
-				if (!m_idle)
-				{
-					m_idle = true;
-					m_idleSignal.notify_all();
-				}
-				
-				m_taskAvailableSignal.wait(lock);
-			}
+				return !m_regionsToSave.empty() || HasLoadTask() || m_exit;
+			});
 			
+			//Pending loads are dropped when exiting, but all saves are completed.
 			if (m_exit && m_regionsToSave.empty())
-			{
 				break;
-			}
 			
 			std::shared_ptr<const Region> regionToSave;
-			if (!m_regionsToSave.empty())
+			bool cacheRegion = false;
+			std::optional<RegionCoordinate> regionToLoad;
+			bool readByRing = false;
+			bool hasRegionData = false;
+			
+			if (!HasLoadTask() || m_exit || m_regionsToSave.size() >= MaxQueuedSaves)
 			{
-				regionToSave = std::move(m_regionsToSave.front());
+				const RegionCoordinate coordinate = m_regionsToSave.front();
 				m_regionsToSave.pop();
+				
+				//Skips saves which have been merged or cancelled, and saves of regions which are already being saved
+				//by another thread (which queues them again when it's done).
+				auto inFlightIt = m_inFlightRegions.find(coordinate);
+				if (inFlightIt == m_inFlightRegions.end() || !inFlightIt->second.m_saveQueued ||
+				    inFlightIt->second.m_saving)
+				{
+					UpdateQueueCounts();
+					if (IsIdle())
+					{
+						m_idleSignal.notify_all();
+					}
+					continue;
+				}
+				
+				inFlightIt->second.m_saveQueued = false;
+				inFlightIt->second.m_saving = true;
+				regionToSave = inFlightIt->second.m_region;
+				cacheRegion = inFlightIt->second.m_evicted && m_regionCache.GetCapacity() != 0;
 			}
-			
-			std::optional<RegionCoordinate> regionToLoad;
-			if (!m_regionsToLoad.empty() && !m_exit)
+			else if (!m_readRegions.empty())
+			{
+				readByRing = true;
+				ReadRegion& readRegion = m_readRegions.back();
+				regionToLoad = readRegion.m_coordinate;
+				if (!readRegion.m_readFailed)
+				{
+					regionData = std::move(readRegion.m_data);
+					hasRegionData = true;
+				}
+				m_readRegions.pop_back();
+			}
+			else
 			{
-				regionToLoad = m_regionsToLoad.front();
-				m_regionsToLoad.pop();
+				//Selects the closest region to the camera for loading. Prefetches are only done once there are no other
+				//loads waiting.
+				auto& regions = m_regionsToLoad.empty() ? m_regionsToPrefetch : m_regionsToLoad;
+				auto selectedIt = std::min_element(MAKE_RANGE(regions), [&] (RegionCoordinate a, RegionCoordinate b)
+				{
+					return RegionCoordinate::DistanceSq(a, m_cameraRegion) <
+					       RegionCoordinate::DistanceSq(b, m_cameraRegion);
+				});
+				
+				regionToLoad = *selectedIt;
+				*selectedIt = regions.back();
+				regions.pop_back();
 			}
 			
+			UpdateQueueCounts();
+			m_numBusyThreads++;
+			
 			lock.unlock();
 			
+			//Saves which fail keep the region in the in-flight table, and loads which fail are reported to the world
+			//manager so that the region is generated instead.
+			bool saveFailed = false;
 			if (regionToSave)
 			{
 #ifdef MCR_REGION_LOG
 				Log("Saving (", regionToSave->GetX(), ", ", regionToSave->GetZ(), ")");
 #endif
 				
-				m_world.SaveRegion(*regionToSave);
+				try
+				{
+					//Clean regions only need to be serialized if they are cached.
+					if (regionToSave->IsDirty())
+					{
+						m_world.SaveRegion(*regionToSave, regionData);
+					}
+					else if (cacheRegion)
+					{
+						World::SerializeRegion(*regionToSave, regionData);
+					}
+				}
+				catch (const std::exception& ex)
+				{
+					Log("Error saving region (", regionToSave->GetX(), ", ", regionToSave->GetZ(), "): ", ex.what());
+					saveFailed = true;
+				}
 			}
 			
 			if (regionToLoad.has_value())
@@ -100,16 +294,234 @@ namespace MCR
 				Log("Loading region (", regionToLoad->x, ", ", regionToLoad->z, ")");
 #endif
 				
-				std::shared_ptr<Region> region = std::make_unique<Region>(regionToLoad->x, regionToLoad->z);
-				m_world.LoadRegion(*region);
+				//The read ring thread has already looked for the region in the region cache.
+				if (!readByRing)
+				{
+					hasRegionData = m_regionCache.Take(*regionToLoad, regionData);
+				}
+				
+				std::shared_ptr<Region> region = m_regionPool.Acquire(regionToLoad->x, regionToLoad->z);
+				try
+				{
+					if (hasRegionData)
+					{
+						World::DeserializeRegion(*region, regionData);
+					}
+					else
+					{
+						m_world.LoadRegion(*region);
+					}
+				}
+				catch (const std::exception& ex)
+				{
+					Log("Error loading region (", regionToLoad->x, ", ", regionToLoad->z, "): ", ex.what());
+					region = nullptr;
+				}
 				
 #ifdef MCR_REGION_LOG
 				Log("Loaded region (", regionToLoad->x, ", ", regionToLoad->z, ")");
 #endif
 				
 				std::lock_guard<std::mutex> loadedRegionsLock(m_outputMutex);
-				m_loadedRegions.emplace_back(std::move(region));
+				if (region != nullptr)
+				{
+					m_loadedRegions.emplace_back(std::move(region));
+				}
+				else
+				{
+					m_failedLoads.push_back(*regionToLoad);
+				}
+			}
+			
+			lock.lock();
+			
+			if (regionToSave)
+			{
+				const RegionCoordinate coordinate = { regionToSave->GetX(), regionToSave->GetZ() };
+				auto inFlightIt = m_inFlightRegions.find(coordinate);
+				inFlightIt->second.m_saving = false;
+				
+				//Regions which are returned to the world manager or registered again while being saved aren't cached,
+				//since the cached data would become outdated.
+				if (cacheRegion && !saveFailed && !inFlightIt->second.m_loadRequested &&
+				    !inFlightIt->second.m_saveQueued)
+				{
+					m_regionCache.Insert(coordinate, std::move(regionData));
+					regionData = { };
+				}
+				
+				if (inFlightIt->second.m_loadRequested)
+				{
+					ReturnInFlightRegion(coordinate);
+				}
+				else if (inFlightIt->second.m_saveQueued)
+				{
+					m_regionsToSave.push(coordinate);
+				}
+				else if (!saveFailed)
+				{
+					m_inFlightRegions.erase(inFlightIt);
+				}
+			}
+			
+			m_numBusyThreads--;
+			UpdateQueueCounts();
+			if (IsIdle())
+			{
+				m_idleSignal.notify_all();
+			}
+		}
+	}
+	
+	void RegionIOThread::ReadRingThreadTarget()
+	{
+		//Reads which have been submitted to the ring, by the user data passed with them.
+		std::unordered_map<uint64_t, PendingRead> pendingReads;
+		uint64_t nextReadId = 0;
+		
+		std::vector<RegionCoordinate> regionsToRead;
+		std::vector<ReadRegion> readRegions;
+		std::vector<RegionReadRing::Completion> completions;
+		
+		std::unique_lock<std::mutex> lock(m_inputMutex);
+		
+		while (true)
+		{
+			m_taskAvailableSignal.wait(lock, [&]
+			{
+				return !m_regionsToLoad.empty() || !m_regionsToPrefetch.empty() || !pendingReads.empty() || m_exit;
+			});
+			
+			//Pending loads are dropped when exiting, but submitted reads must complete before their buffers are freed.
+			if (m_exit && pendingReads.empty())
+				break;
+			
+			//Takes all loads registered since the last submission, closest to the camera first if there isn't room
+			//for all of them in the ring. Prefetches use the room left over by other loads.
+			regionsToRead.clear();
+			if (!m_exit)
+			{
+				for (std::vector<RegionCoordinate>* regions : { &m_regionsToLoad, &m_regionsToPrefetch })
+				{
+					std::sort(MAKE_RANGE(*regions), [&] (RegionCoordinate a, RegionCoordinate b)
+					{
+						return RegionCoordinate::DistanceSq(a, m_cameraRegion) <
+						       RegionCoordinate::DistanceSq(b, m_cameraRegion);
+					});
+					
+					const size_t numToRead = std::min(regions->size(), static_cast<size_t>(ReadRingEntries) -
+					                                  pendingReads.size() - regionsToRead.size());
+					regionsToRead.insert(regionsToRead.end(), regions->begin(), regions->begin() + numToRead);
+					regions->erase(regions->begin(), regions->begin() + numToRead);
+				}
+				
+				m_numReading += regionsToRead.size();
+				UpdateQueueCounts();
+			}
+			
+			lock.unlock();
+			
+			for (RegionCoordinate coordinate : regionsToRead)
+			{
+				ReadRegion readRegion;
+				readRegion.m_coordinate = coordinate;
+				
+				if (m_regionCache.Take(coordinate, readRegion.m_data))
+				{
+					readRegions.push_back(std::move(readRegion));
+					continue;
+				}
+				
+				//Regions which can't be read through the ring are loaded with LoadRegion, which reports the error if
+				//it fails as well.
+				try
+				{
+					RegionContainer::DataLocation location;
+					std::shared_ptr<RegionContainer> container = m_world.GetRegionLocation(coordinate.x, coordinate.z,
+					                                                                       location);
+					if (container != nullptr)
+					{
+						readRegion.m_data.resize(location.m_length);
+						if (m_readRing->QueueRead(container->GetFileHandle(), location.m_offset,
+						                          readRegion.m_data.data(), location.m_length, nextReadId))
+						{
+							pendingReads.emplace(nextReadId++, PendingRead { std::move(readRegion),
+							                                                 std::move(container) });
+							continue;
+						}
+					}
+				}
+				catch (const std::exception&) { }
+				
+				readRegion.m_readFailed = true;
+				readRegions.push_back(std::move(readRegion));
 			}
+			
+			bool ringFailed = false;
+			try
+			{
+				//All reads from this batch are submitted with a single system call.
+				m_readRing->Submit();
+				
+				//Completions are only waited for if there are no other regions to hand to the IO threads.
+				if (readRegions.empty() && !pendingReads.empty())
+				{
+					m_readRing->WaitCompletions(completions);
+					
+					for (const RegionReadRing::Completion& completion : completions)
+					{
+						auto pendingIt = pendingReads.find(completion.m_userData);
+						ReadRegion& readRegion = pendingIt->second.m_region;
+						
+						//Failed and short reads fall back to LoadRegion, which reports the error if it fails as well.
+						if (completion.m_result != static_cast<int32_t>(readRegion.m_data.size()))
+						{
+							readRegion.m_readFailed = true;
+						}
+						
+						readRegions.push_back(std::move(readRegion));
+						pendingReads.erase(pendingIt);
+					}
+				}
+			}
+			catch (const std::exception& ex)
+			{
+				Log("Stopped reading regions through io_uring: ", ex.what());
+				ringFailed = true;
+			}
+			
+			lock.lock();
+			
+			//Once the ring has failed, reads which haven't completed are loaded with LoadRegion instead, and the IO
+			//threads take over loading regions.
+			if (ringFailed)
+			{
+				for (auto& pendingRead : pendingReads)
+				{
+					ReadRegion readRegion;
+					readRegion.m_coordinate = pendingRead.second.m_region.m_coordinate;
+					readRegion.m_readFailed = true;
+					readRegions.push_back(std::move(readRegion));
+					
+					m_abandonedReads.push_back(std::move(pendingRead.second));
+				}
+				pendingReads.clear();
+				
+				m_useReadRing = false;
+			}
+			
+			m_numReading -= readRegions.size();
+			std::move(MAKE_RANGE(readRegions), std::back_inserter(m_readRegions));
+			readRegions.clear();
+			
+			m_taskAvailableSignal.notify_all();
+			if (IsIdle())
+			{
+				m_idleSignal.notify_all();
+			}
+			
+			if (ringFailed)
+				break;
 		}
 	}
 }
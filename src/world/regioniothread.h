@@ -4,17 +4,27 @@
 #include <mutex>
 #include <queue>
 #include <condition_variable>
-#include <stack>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdlib>
+#include <unordered_map>
 
 #include "region.h"
 #include "newregion.h"
 
 namespace MCR
 {
+	//Loads and saves regions on a pool of threads. Loads are done in order of distance from the camera, and take
+	//priority over saves unless too many saves are waiting. Regions registered for saving are kept in an in-flight
+	//table until they have been written, loads of those regions are served from memory instead of from disk.
+	//On Linux, region data is read through io_uring when available: the loads registered in one registering window
+	//are submitted as a batch by a single thread, and the IO threads only decompress the data once it has been read.
 	class RegionIOThread final
 	{
 	public:
-		explicit RegionIOThread(class World& world);
+		RegionIOThread(size_t numThreads, class World& world, class RegionPool& regionPool,
+		               class RegionCache& regionCache);
 		~RegionIOThread();
 		
 		void WaitIdle();
@@ -23,24 +33,68 @@ namespace MCR
 		
 		void EndRegistering();
 		
-		//Only call between BeginPolling and EndPolling.
-		inline void RegisterForSaving(std::shared_ptr<const Region> region)
+		//Saves the region if it is dirty. Regions which have been evicted from the loaded area are also added to the
+		//region cache. Registering a region which is already waiting to be saved replaces the waiting region, so
+		//that it is only saved once. Only call between BeginRegistering and EndRegistering.
+		void RegisterForSaving(std::shared_ptr<const Region> region, bool evicted);
+		
+		//Only call between BeginRegistering and EndRegistering.
+		void RegisterForLoading(RegionCoordinate coordinate);
+		
+		//Loads a region which is expected to enter the load area soon. Prefetches are only done when no other loads
+		//are waiting, and aren't cancelled by SetLoadArea. Only call between BeginRegistering and EndRegistering.
+		void RegisterForPrefetching(RegionCoordinate coordinate);
+		
+		//Moves a prefetch which hasn't started into the regular load queue, for when the region has entered the load
+		//area. Returns false if the region isn't waiting to be prefetched. Only call between BeginRegistering and
+		//EndRegistering.
+		bool PromotePrefetch(RegionCoordinate coordinate);
+		
+		//Returns true if a region is in the in-flight table, in which case it should be loaded even if the world
+		//doesn't have it yet. Only call between BeginRegistering and EndRegistering.
+		inline bool IsInFlight(RegionCoordinate coordinate) const
+		{
+			return m_inFlightRegions.count(coordinate) != 0;
+		}
+		
+		//Sets the area regions are loaded for, loads of regions outside it are cancelled. Only call between
+		//BeginRegistering and EndRegistering.
+		void SetLoadArea(RegionCoordinate cameraRegion, int loadDistance);
+		
+		//The number of loads and saves waiting for a thread, can be called at any time.
+		inline size_t GetNumQueuedLoads() const
 		{
-			m_regionsToSave.push(std::move(region));
-			m_anyEnqueued = true;
+			return m_numQueuedLoads.load(std::memory_order_relaxed);
 		}
 		
-		//Only call between BeginPolling and EndPolling.
-		inline void RegisterForLoading(RegionCoordinate coordinate)
+		inline size_t GetNumQueuedSaves() const
 		{
-			m_regionsToLoad.push(std::move(coordinate));
-			m_anyEnqueued = true;
+			return m_numQueuedSaves.load(std::memory_order_relaxed);
 		}
 		
-		//Only call between BeginPolling and EndPolling.
-		inline size_t GetNumEnqueuedForLoad() const
+		//The number of loads which have been cancelled because their region left the load area.
+		inline uint64_t GetNumCancelledLoads() const
 		{
-			return m_regionsToLoad.size();
+			return m_numCancelledLoads.load(std::memory_order_relaxed);
+		}
+		
+		//The number of saves which were merged into an earlier save of the same region.
+		inline uint64_t GetNumMergedSaves() const
+		{
+			return m_numMergedSaves.load(std::memory_order_relaxed);
+		}
+		
+		//The number of loads which were served from the in-flight table.
+		inline uint64_t GetNumInFlightLoads() const
+		{
+			return m_numInFlightLoads.load(std::memory_order_relaxed);
+		}
+		
+		//Returns true if region data is read through io_uring, see RegionReadRing. The read ring is stopped if it
+		//reports an error, after which regions are read with LoadRegion.
+		inline bool IsUsingReadRing() const
+		{
+			return m_useReadRing.load(std::memory_order_relaxed);
 		}
 		
 		template <typename CallbackTp>
@@ -55,28 +109,147 @@ namespace MCR
 			m_loadedRegions.clear();
 		}
 		
+		//Calls callback with the coordinate of each region which couldn't be loaded because of an error since the
+		//last call. These regions should be generated instead.
+		template <typename CallbackTp>
+		void IterateFailedLoads(CallbackTp callback)
+		{
+			std::lock_guard<std::mutex> lock(m_outputMutex);
+			
+			for (RegionCoordinate coordinate : m_failedLoads)
+			{
+				callback(coordinate);
+			}
+			m_failedLoads.clear();
+		}
+		
 	private:
 		void ThreadTarget();
 		
+		//Submits reads of the regions waiting to be loaded to the read ring, and passes completed reads on to the IO
+		//threads. Only used if the read ring is available.
+		void ReadRingThreadTarget();
+		
+		//With the read ring, the IO threads only load regions once their data has been read.
+		inline bool HasLoadTask() const
+		{
+			return !m_readRegions.empty() ||
+			       (!m_useReadRing && (!m_regionsToLoad.empty() || !m_regionsToPrefetch.empty()));
+		}
+		
+		inline bool IsInLoadArea(RegionCoordinate coordinate) const
+		{
+			return std::abs(coordinate.x - m_cameraRegion.x) <= m_loadDistance &&
+			       std::abs(coordinate.z - m_cameraRegion.z) <= m_loadDistance;
+		}
+		
+		inline bool IsIdle() const
+		{
+			return m_regionsToSave.empty() && m_regionsToLoad.empty() && m_regionsToPrefetch.empty() &&
+			       m_readRegions.empty() && m_numReading == 0 && m_numBusyThreads == 0;
+		}
+		
+		inline void UpdateQueueCounts()
+		{
+			m_numQueuedLoads.store(m_regionsToLoad.size(), std::memory_order_relaxed);
+			m_numQueuedSaves.store(m_regionsToSave.size(), std::memory_order_relaxed);
+		}
+		
+		//Hands a region from the in-flight table back to the world manager and removes it from the table. The input
+		//mutex must be held.
+		void ReturnInFlightRegion(RegionCoordinate coordinate);
+		
+		//Once this many saves are queued, saves are done before loads to bound the memory held by the save queue.
+		static constexpr size_t MaxQueuedSaves = 64;
+		
+		//The maximum number of reads submitted to the read ring at once.
+		static constexpr uint32_t ReadRingEntries = 64;
+		
 		bool m_exit = false;
 		
 		bool m_anyEnqueued = false;
 		
-		bool m_idle = false;
-		std::condition_variable m_idleSignal;
+		//The number of threads which are currently loading or saving a region.
+		uint32_t m_numBusyThreads = 0;
 		
 		class World& m_world;
+		class RegionPool& m_regionPool;
+		class RegionCache& m_regionCache;
 		
 		std::mutex m_inputMutex;
 		std::mutex m_outputMutex;
 		
-		std::queue<std::shared_ptr<const Region>> m_regionsToSave;
-		std::queue<RegionCoordinate> m_regionsToLoad;
+		RegionCoordinate m_cameraRegion = { 0, 0 };
+		int64_t m_loadDistance = INT32_MAX;
+		
+		struct InFlightRegion
+		{
+			//The most recently registered version of the region.
+			std::shared_ptr<const Region> m_region;
+			
+			bool m_saveQueued = false;
+			bool m_evicted = false;
+			
+			//Set while a thread is writing the region. Only one thread saves a region at a time.
+			bool m_saving = false;
+			
+			//Set if the region was registered for loading while being saved, it is returned once the save completes.
+			bool m_loadRequested = false;
+		};
+		
+		std::unordered_map<RegionCoordinate, InFlightRegion, RegionCoordinateHash> m_inFlightRegions;
+		
+		//Coordinates of regions in the in-flight table to save. Entries whose save has been cancelled or merged are
+		//skipped when popped.
+		std::queue<RegionCoordinate> m_regionsToSave;
+		std::vector<RegionCoordinate> m_regionsToLoad;
+		std::vector<RegionCoordinate> m_regionsToPrefetch;
+		
+		struct ReadRegion
+		{
+			RegionCoordinate m_coordinate;
+			std::vector<uint8_t> m_data;
+			
+			//Set if the region couldn't be read through the ring, in which case it is loaded with LoadRegion.
+			bool m_readFailed = false;
+		};
+		
+		//Regions whose data has been read by the read ring thread, waiting to be decompressed.
+		std::vector<ReadRegion> m_readRegions;
+		
+		//The number of regions taken from m_regionsToLoad by the read ring thread which haven't been added to
+		//m_readRegions yet.
+		size_t m_numReading = 0;
+		
+		//A read submitted to the read ring. The container is kept with the read so that its file stays open until
+		//the read completes.
+		struct PendingRead
+		{
+			ReadRegion m_region;
+			std::shared_ptr<class RegionContainer> m_container;
+		};
+		
+		//Reads which were submitted before the read ring failed. The kernel may still write to their buffers, so they
+		//are kept until the ring has been destroyed.
+		std::vector<PendingRead> m_abandonedReads;
+		
+		std::unique_ptr<class RegionReadRing> m_readRing;
+		
+		//Cleared if the read ring fails, the IO threads then load regions from m_regionsToLoad themselves.
+		std::atomic<bool> m_useReadRing { false };
+		
+		std::atomic<size_t> m_numQueuedLoads { 0 };
+		std::atomic<size_t> m_numQueuedSaves { 0 };
+		std::atomic<uint64_t> m_numCancelledLoads { 0 };
+		std::atomic<uint64_t> m_numMergedSaves { 0 };
+		std::atomic<uint64_t> m_numInFlightLoads { 0 };
 		
 		std::condition_variable m_taskAvailableSignal;
+		std::condition_variable m_idleSignal;
 		
 		std::vector<NewRegion> m_loadedRegions;
+		std::vector<RegionCoordinate> m_failedLoads;
 		
-		std::thread m_thread;
+		std::vector<std::thread> m_threads;
 	};
 }
@@ -0,0 +1,59 @@
+#include "regionpool.h"
+
+namespace MCR
+{
+	RegionPool::RegionPool(size_t capacity)
+	    : m_capacity(capacity) { }
+	
+	std::shared_ptr<Region> RegionPool::Acquire(int64_t coordX, int64_t coordZ)
+	{
+		std::shared_ptr<Region> region;
+		bool recycled = false;
+		
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			
+			//Nothing else can gain a reference to a region once only the pool references it, so copying it here
+			//reserves it without racing against other threads.
+			for (size_t i = 0; i < m_regions.size(); i++)
+			{
+				const size_t index = (m_searchStart + i) % m_regions.size();
+				if (m_regions[index].use_count() == 1)
+				{
+					region = m_regions[index];
+					recycled = true;
+					m_searchStart = index + 1;
+					break;
+				}
+			}
+			
+			if (region == nullptr && m_regions.size() < m_capacity)
+			{
+				region = std::make_shared<Region>(coordX, coordZ);
+				m_regions.push_back(region);
+			}
+		}
+		
+		if (!recycled)
+		{
+			m_misses++;
+			return region != nullptr ? region : std::make_shared<Region>(coordX, coordZ);
+		}
+		
+		m_hits++;
+		region->Reset(coordX, coordZ);
+		return region;
+	}
+	
+	void RegionPool::SetCapacity(size_t capacity)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		m_capacity = capacity;
+		if (m_regions.size() > capacity)
+		{
+			m_regions.resize(capacity);
+			m_searchStart = 0;
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+#include "region.h"
+
+namespace MCR
+{
+	//Recycles regions once nothing but the pool references them, so that regions leaving the loaded area can be
+	//reused for newly generated or loaded regions without allocating a new region, shared_ptr control block and chunk
+	//buffers. All functions are thread safe.
+	class RegionPool
+	{
+	public:
+		explicit RegionPool(size_t capacity = 0);
+		
+		//Returns an empty region at the given coordinate, reusing a pooled region if one is available.
+		std::shared_ptr<Region> Acquire(int64_t coordX, int64_t coordZ);
+		
+		//Sets the maximum number of regions tracked by the pool. Regions beyond this limit are allocated normally.
+		void SetCapacity(size_t capacity);
+		
+		//The number of calls to Acquire which reused a pooled region.
+		inline uint64_t GetHits() const
+		{
+			return m_hits.load(std::memory_order_relaxed);
+		}
+		
+		//The number of calls to Acquire which had to allocate a new region.
+		inline uint64_t GetMisses() const
+		{
+			return m_misses.load(std::memory_order_relaxed);
+		}
+		
+	private:
+		std::mutex m_mutex;
+		
+		size_t m_capacity;
+		
+		//All regions tracked by the pool, a region is free when the pool holds the only reference to it.
+		std::vector<std::shared_ptr<Region>> m_regions;
+		
+		//Index to start searching for free regions from, so that searches don't repeatedly scan regions in use.
+		size_t m_searchStart = 0;
+		
+		std::atomic<uint64_t> m_hits { 0 };
+		std::atomic<uint64_t> m_misses { 0 };
+	};
+}
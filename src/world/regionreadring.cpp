@@ -0,0 +1,211 @@
+#include "regionreadring.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifdef MCR_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//Older C libraries don't define the system call numbers, which are the same on all architectures.
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#endif
+#endif
+
+namespace MCR
+{
+#ifdef MCR_IO_URING
+	//The ring is used through the raw system calls, so liburing isn't needed.
+	static int IOUringSetup(uint32_t numEntries, io_uring_params& params)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_setup, numEntries, &params));
+	}
+	
+	static int IOUringEnter(int ringFd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+	}
+	
+	//The ring indices are shared with the kernel, so they are accessed with acquire and release semantics.
+	inline uint32_t LoadAcquire(const uint32_t* value)
+	{
+		return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+	}
+	
+	inline void StoreRelease(uint32_t* value, uint32_t newValue)
+	{
+		__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+	}
+	
+	template <typename T>
+	inline T* RingPointer(void* ring, uint32_t offset)
+	{
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(ring) + offset);
+	}
+	
+	std::unique_ptr<RegionReadRing> RegionReadRing::Create(uint32_t numEntries)
+	{
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		
+		const int ringFd = IOUringSetup(numEntries, params);
+		if (ringFd < 0)
+			return nullptr;
+		
+		std::unique_ptr<RegionReadRing> ring(new RegionReadRing);
+		ring->m_ringFd = ringFd;
+		
+		ring->m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		ring->m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		
+		//Newer kernels map both rings with a single mapping.
+		const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMap)
+		{
+			ring->m_sqRingSize = ring->m_cqRingSize = std::max(ring->m_sqRingSize, ring->m_cqRingSize);
+		}
+		
+		ring->m_sqRing = mmap(nullptr, ring->m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                      ringFd, IORING_OFF_SQ_RING);
+		if (ring->m_sqRing == MAP_FAILED)
+		{
+			ring->m_sqRing = nullptr;
+			return nullptr;
+		}
+		
+		if (singleMap)
+		{
+			ring->m_cqRing = ring->m_sqRing;
+		}
+		else
+		{
+			ring->m_cqRing = mmap(nullptr, ring->m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			                      ringFd, IORING_OFF_CQ_RING);
+			if (ring->m_cqRing == MAP_FAILED)
+			{
+				ring->m_cqRing = nullptr;
+				return nullptr;
+			}
+		}
+		
+		ring->m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void* sqes = mmap(nullptr, ring->m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+		                  IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+			return nullptr;
+		ring->m_sqes = reinterpret_cast<io_uring_sqe*>(sqes);
+		
+		ring->m_sqHead = RingPointer<uint32_t>(ring->m_sqRing, params.sq_off.head);
+		ring->m_sqTail = RingPointer<uint32_t>(ring->m_sqRing, params.sq_off.tail);
+		ring->m_sqArray = RingPointer<uint32_t>(ring->m_sqRing, params.sq_off.array);
+		ring->m_sqMask = *RingPointer<uint32_t>(ring->m_sqRing, params.sq_off.ring_mask);
+		ring->m_sqEntries = params.sq_entries;
+		
+		ring->m_cqHead = RingPointer<uint32_t>(ring->m_cqRing, params.cq_off.head);
+		ring->m_cqTail = RingPointer<uint32_t>(ring->m_cqRing, params.cq_off.tail);
+		ring->m_cqMask = *RingPointer<uint32_t>(ring->m_cqRing, params.cq_off.ring_mask);
+		ring->m_cqes = RingPointer<io_uring_cqe>(ring->m_cqRing, params.cq_off.cqes);
+		
+		return ring;
+	}
+	
+	RegionReadRing::~RegionReadRing()
+	{
+		if (m_sqes != nullptr)
+			munmap(m_sqes, m_sqesSize);
+		if (m_cqRing != nullptr && m_cqRing != m_sqRing)
+			munmap(m_cqRing, m_cqRingSize);
+		if (m_sqRing != nullptr)
+			munmap(m_sqRing, m_sqRingSize);
+		close(m_ringFd);
+	}
+	
+	bool RegionReadRing::QueueRead(intptr_t file, uint64_t offset, void* buffer, uint32_t size, uint64_t userData)
+	{
+		//Only this thread writes the tail, but the kernel advances the head as it consumes entries.
+		const uint32_t tail = *m_sqTail;
+		if (tail - LoadAcquire(m_sqHead) >= m_sqEntries)
+			return false;
+		
+		const uint32_t index = tail & m_sqMask;
+		io_uring_sqe& sqe = m_sqes[index];
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READ;
+		sqe.fd = static_cast<int>(file);
+		sqe.off = offset;
+		sqe.addr = reinterpret_cast<uint64_t>(buffer);
+		sqe.len = size;
+		sqe.user_data = userData;
+		
+		m_sqArray[index] = index;
+		StoreRelease(m_sqTail, tail + 1);
+		m_numQueued++;
+		return true;
+	}
+	
+	void RegionReadRing::Submit()
+	{
+		while (m_numQueued > 0)
+		{
+			const int numSubmitted = IOUringEnter(m_ringFd, m_numQueued, 0, 0);
+			if (numSubmitted < 0)
+			{
+				if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+					continue;
+				throw std::runtime_error("Error submitting reads to io_uring.");
+			}
+			m_numQueued -= static_cast<uint32_t>(numSubmitted);
+		}
+	}
+	
+	void RegionReadRing::WaitCompletions(std::vector<Completion>& completions)
+	{
+		completions.clear();
+		
+		uint32_t head = *m_cqHead;
+		uint32_t tail = LoadAcquire(m_cqTail);
+		while (head == tail)
+		{
+			if (IOUringEnter(m_ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+			{
+				throw std::runtime_error("Error waiting for io_uring completions.");
+			}
+			tail = LoadAcquire(m_cqTail);
+		}
+		
+		for (; head != tail; head++)
+		{
+			const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+			completions.push_back({ cqe.user_data, cqe.res });
+		}
+		
+		//Releases the entries back to the kernel once they have been copied.
+		StoreRelease(m_cqHead, head);
+	}
+#else
+	std::unique_ptr<RegionReadRing> RegionReadRing::Create(uint32_t numEntries)
+	{
+		return nullptr;
+	}
+	
+	RegionReadRing::~RegionReadRing() { }
+	
+	bool RegionReadRing::QueueRead(intptr_t file, uint64_t offset, void* buffer, uint32_t size, uint64_t userData)
+	{
+		return false;
+	}
+	
+	void RegionReadRing::Submit() { }
+	
+	void RegionReadRing::WaitCompletions(std::vector<Completion>& completions)
+	{
+		completions.clear();
+	}
+#endif
+}
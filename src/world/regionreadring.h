@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+//io_uring support can be disabled at compile time by defining MCR_NO_IO_URING.
+#if defined(__linux__) && !defined(MCR_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#define MCR_IO_URING
+#endif
+#endif
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace MCR
+{
+	//Reads from files asynchronously using io_uring, so that many reads can be submitted with a single system call
+	//and completed without a thread blocking on each of them. Only available on Linux, and only if the kernel supports
+	//io_uring (it may also be disabled by seccomp in containers).
+	//QueueRead and Submit must only be called by one thread at a time, and WaitCompletions by one thread at a time,
+	//but the two groups can be called concurrently.
+	class RegionReadRing
+	{
+	public:
+		//Returns null if io_uring isn't available.
+		static std::unique_ptr<RegionReadRing> Create(uint32_t numEntries);
+		
+		~RegionReadRing();
+		
+		RegionReadRing(const RegionReadRing& other) = delete;
+		RegionReadRing& operator=(const RegionReadRing& other) = delete;
+		
+		//Queues a read of size bytes at offset into buffer, which must stay alive until the read completes. userData
+		//identifies the read in its completion. Returns false if the submission queue is full.
+		bool QueueRead(intptr_t file, uint64_t offset, void* buffer, uint32_t size, uint64_t userData);
+		
+		//Submits all queued reads to the kernel.
+		void Submit();
+		
+		struct Completion
+		{
+			uint64_t m_userData;
+			
+			//The number of bytes read, or a negated errno value if the read failed.
+			int32_t m_result;
+		};
+		
+		//Blocks until at least one submitted read has completed, then replaces the contents of completions with all
+		//completed reads.
+		void WaitCompletions(std::vector<Completion>& completions);
+		
+	private:
+		RegionReadRing() = default;
+		
+		int m_ringFd = -1;
+		
+		void* m_sqRing = nullptr;
+		void* m_cqRing = nullptr;
+		size_t m_sqRingSize = 0;
+		size_t m_cqRingSize = 0;
+		
+		io_uring_sqe* m_sqes = nullptr;
+		size_t m_sqesSize = 0;
+		
+		uint32_t* m_sqHead;
+		uint32_t* m_sqTail;
+		uint32_t* m_sqArray;
+		uint32_t m_sqMask;
+		uint32_t m_sqEntries;
+		
+		uint32_t* m_cqHead;
+		uint32_t* m_cqTail;
+		uint32_t m_cqMask;
+		io_uring_cqe* m_cqes;
+		
+		//The number of reads which have been queued but not yet consumed by the kernel.
+		uint32_t m_numQueued = 0;
+	};
+}
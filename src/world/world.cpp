@@ -1,4 +1,6 @@
 #include "world.h"
+#include "worldgenerator.h"
+#include "regionreadring.h"
 #include "../utils.h"
 
 #include <zlib.h>
@@ -6,12 +8,22 @@
 #include <sstream>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 
 namespace MCR
 {
 	const uint16_t WorldVersion = 1;
 	const char WorldMagic[] = { 'M', 'W' };
 	const char RegionMagic[] = { 'M', 'R' };
+	const char IndexMagic[] = { 'M', 'I' };
+	
+	const uint16_t IndexVersion = 1;
+	
+	//Version 2 stores non uniform chunks compressed with zlib, version 1 stored them uncompressed.
+	const uint16_t RegionVersion = 2;
+	
+	//Set on a chunk index in a region file if the chunk is stored as a single block entry.
+	const uint8_t UniformChunkFlag = 0x80;
 	
 #pragma pack(push, 1)
 	struct WorldHeader
@@ -21,8 +33,75 @@ namespace MCR
 		glm::vec3 m_cameraPosition;
 		glm::vec2 m_cameraRotation;
 	};
+	
+	struct RegionHeader
+	{
+		char m_magic[sizeof(RegionMagic)];
+		uint16_t m_version;
+		uint8_t m_chunkCount;
+	};
+	
+	//The index file consists of this header followed by the coordinates of the saved regions, as pairs of int64_t.
+	struct IndexHeader
+	{
+		char m_magic[sizeof(IndexMagic)];
+		uint16_t m_version;
+	};
 #pragma pack(pop)
 	
+	//Region containers are stored in files named after their coordinates, see RegionContainer::GetContainerCoordinate.
+	const char ContainerExtension[] = ".mcc";
+	
+	inline fs::path GetContainerPath(const fs::path& dirPath, RegionCoordinate coordinate)
+	{
+		return dirPath / (std::to_string(coordinate.x) + "_" + std::to_string(coordinate.z) + ContainerExtension);
+	}
+	
+	//Parses the coordinate of a container from its path, returns false if the path isn't a container file.
+	static bool ParseContainerPath(const fs::path& path, RegionCoordinate& coordinate)
+	{
+		if (path.extension() != ContainerExtension)
+			return false;
+		
+		char separator;
+		std::istringstream nameStream(path.stem().string());
+		return nameStream >> coordinate.x >> separator >> coordinate.z && separator == '_' && nameStream.eof();
+	}
+	
+	//Copies bytes out of serialized region data, advancing offset past them.
+	inline void ReadRegionData(gsl::span<const uint8_t> data, size_t& offset, void* out, size_t size)
+	{
+		if (offset + size > static_cast<size_t>(data.size()))
+		{
+			throw std::runtime_error("Invalid region data.");
+		}
+		std::memcpy(out, data.data() + offset, size);
+		offset += size;
+	}
+	
+	template <typename T>
+	inline T ReadRegionData(gsl::span<const uint8_t> data, size_t& offset)
+	{
+		T value;
+		ReadRegionData(data, offset, &value, sizeof(T));
+		return value;
+	}
+	
+	inline void WriteRegionData(std::vector<uint8_t>& data, const void* in, size_t size)
+	{
+		const uint8_t* inBytes = reinterpret_cast<const uint8_t*>(in);
+		data.insert(data.end(), inBytes, inBytes + size);
+	}
+	
+	//Scratch buffers used when loading and saving regions, with one set for each thread doing region IO.
+	struct RegionIOBuffers
+	{
+		std::vector<Region::BlockEntry> m_blocks;
+		std::vector<uint8_t> m_regionData;
+	};
+	
+	static thread_local RegionIOBuffers ioBuffers;
+	
 	World::World(const fs::path& dirPath)
 	    : m_path(dirPath)
 	{
@@ -46,6 +125,79 @@ namespace MCR
 			m_cameraPosition = header.m_cameraPosition;
 			m_cameraRotation = header.m_cameraRotation;
 		}
+		
+		LoadRegionIndex();
+	}
+	
+	void World::LoadRegionIndex()
+	{
+		const fs::path indexPath = m_path / "regions";
+		
+		std::ifstream indexStream(indexPath, std::ios::binary);
+		if (indexStream)
+		{
+			IndexHeader header;
+			indexStream.read(reinterpret_cast<char*>(&header), sizeof(header));
+			if (!indexStream || std::memcmp(header.m_magic, IndexMagic, sizeof(IndexMagic)) != 0 ||
+			    header.m_version != IndexVersion)
+			{
+				throw std::runtime_error("Invalid region index file.");
+			}
+			
+			std::vector<RegionCoordinate> coordinates;
+			RegionCoordinate coordinate;
+			while (indexStream.read(reinterpret_cast<char*>(&coordinate), sizeof(coordinate)))
+			{
+				coordinates.push_back(coordinate);
+			}
+			
+			//A partially written entry at the end (from being interrupted while appending) would misalign every entry
+			//appended after it, and the region it belongs to would be missing from the index. Such an index is rebuilt
+			//from the containers instead.
+			if (indexStream.gcount() == 0)
+			{
+				for (RegionCoordinate indexedCoordinate : coordinates)
+				{
+					m_regionIndex.Insert(indexedCoordinate);
+				}
+			
+				m_indexStream.open(indexPath, std::ios::binary | std::ios::app);
+				return;
+			}
+		
+			Log("Rebuilding region index with a partially written entry.");
+			indexStream.close();
+		}
+		
+		//Without a valid index file, the index is rebuilt from the slot tables of the containers in the world
+		//directory. This only happens once, since the index file is written afterwards.
+		std::vector<RegionCoordinate> coordinates;
+		if (fs::exists(m_path))
+		{
+			for (const fs::directory_entry& entry : fs::directory_iterator(m_path))
+			{
+				RegionCoordinate containerCoordinate;
+				if (!ParseContainerPath(entry.path(), containerCoordinate))
+					continue;
+				
+				RegionContainer container(entry.path());
+				container.ForEachRegion([&] (uint32_t slot)
+				{
+					coordinates.push_back(RegionContainer::GetRegionCoordinate(containerCoordinate, slot));
+					m_regionIndex.Insert(coordinates.back());
+				});
+			}
+		}
+		
+		IndexHeader header;
+		std::copy(MAKE_RANGE(IndexMagic), header.m_magic);
+		header.m_version = IndexVersion;
+		
+		m_indexStream.open(indexPath, std::ios::binary | std::ios::trunc);
+		m_indexStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		m_indexStream.write(reinterpret_cast<const char*>(coordinates.data()),
+		                    coordinates.size() * sizeof(RegionCoordinate));
+		m_indexStream.flush();
 	}
 	
 	void World::Save() const
@@ -62,71 +214,391 @@ namespace MCR
 	
 	bool World::HasRegion(int64_t x, int64_t z)
 	{
-		std::lock_guard<std::mutex> lock(m_regionsMutex);
+		return m_regionIndex.Contains({ x, z });
+	}
+	
+	std::shared_ptr<RegionContainer> World::GetContainer(int64_t x, int64_t z, bool create)
+	{
+		//Limits the number of open container files. Regions are loaded and saved around the camera, so closing the
+		//containers once the limit is reached only costs reopening the few which are still in use.
+		constexpr size_t MaxOpenContainers = 64;
+		
+		const RegionCoordinate containerCoordinate = RegionContainer::GetContainerCoordinate(x, z);
+		
+		std::lock_guard<std::mutex> lock(m_containersMutex);
+		
+		auto containerIt = m_containers.find(containerCoordinate);
+		if (containerIt != m_containers.end())
+			return containerIt->second;
+		
+		//Looking up regions which haven't been saved doesn't create container files for them.
+		const fs::path containerPath = GetContainerPath(m_path, containerCoordinate);
+		if (!create && !fs::exists(containerPath))
+			return nullptr;
+		
+		//Containers in use by other threads are kept open, since opening a second handle to the same file would
+		//allocate sectors without knowing about the other handle's allocations.
+		if (m_containers.size() >= MaxOpenContainers)
+		{
+			for (auto it = m_containers.begin(); it != m_containers.end();)
+			{
+				if (it->second.use_count() == 1)
+					it = m_containers.erase(it);
+				else
+					++it;
+			}
+		}
 		
-		auto regionIt = std::find_if(MAKE_RANGE(m_regions), [&] (const RegionCoordinate& region)
+		std::shared_ptr<RegionContainer>& container = m_containers[containerCoordinate];
+		container = std::make_shared<RegionContainer>(containerPath, create);
+		return container;
+	}
+	
+	void World::LoadRegion(Region& region)
+	{
+		std::vector<uint8_t>& data = ioBuffers.m_regionData;
+		std::shared_ptr<RegionContainer> container = GetContainer(region.GetX(), region.GetZ(), false);
+		if (container == nullptr || !container->Read(RegionContainer::GetSlot(region.GetX(), region.GetZ()), data))
 		{
-			return region.x == x && region.z == z;
-		});
+			throw std::runtime_error("Region not found in region container.");
+		}
 		
-		return regionIt != m_regions.end();
+		DeserializeRegion(region, data);
 	}
 	
-	std::string World::GetRegionPath(int64_t x, int64_t z)
+	std::shared_ptr<RegionContainer> World::GetRegionLocation(int64_t x, int64_t z,
+	                                                          RegionContainer::DataLocation& location)
 	{
-		std::ostringstream nameStream;
-		nameStream << m_path.string() << "/" << x << "_" << z;
-		return nameStream.str();
+		std::shared_ptr<RegionContainer> container = GetContainer(x, z, false);
+		if (container == nullptr || !container->GetDataLocation(RegionContainer::GetSlot(x, z), location))
+			return nullptr;
+		return container;
 	}
 	
-	void World::LoadRegion(Region& region)
+	void World::DeserializeRegion(Region& region, gsl::span<const uint8_t> data)
 	{
-		std::ifstream stream(GetRegionPath(region.GetX(), region.GetZ()), std::ios::binary);
+		size_t offset = 0;
 		
-		char magic[sizeof(RegionMagic)];
-		stream.read(magic, sizeof(magic));
-		if (std::memcmp(magic, RegionMagic, sizeof(RegionMagic)) != 0)
+		const RegionHeader header = ReadRegionData<RegionHeader>(data, offset);
+		if (std::memcmp(header.m_magic, RegionMagic, sizeof(RegionMagic)) != 0)
 		{
-			throw std::runtime_error("Invalid region file.");
+			throw std::runtime_error("Invalid region data.");
 		}
 		
-		uint8_t chunkCount;
-		stream.read(reinterpret_cast<char*>(&chunkCount), sizeof(chunkCount));
+		if (header.m_version != RegionVersion)
+		{
+			throw std::runtime_error("Unsupported region version number.");
+		}
 		
-		if (chunkCount != 0)
+		if (header.m_chunkCount > Region::ChunkCount)
 		{
-			uint8_t* chunkIndices = reinterpret_cast<uint8_t*>(alloca(chunkCount));
-			stream.read(reinterpret_cast<char*>(chunkIndices), chunkCount * sizeof(uint8_t));
+			throw std::runtime_error("Invalid region data.");
+		}
+			
+		uint8_t chunkIndices[Region::ChunkCount];
+		ReadRegionData(data, offset, chunkIndices, header.m_chunkCount * sizeof(uint8_t));
+		
+		ioBuffers.m_blocks.resize(ChunkStorage::BlockCount);
+		
+		for (uint8_t i = 0; i < header.m_chunkCount; i++)
+		{
+			const uint32_t chunkIndex = chunkIndices[i] & ~UniformChunkFlag;
+			if (chunkIndex >= Region::ChunkCount)
+			{
+				throw std::runtime_error("Invalid region data.");
+			}
+			
+			if (chunkIndices[i] & UniformChunkFlag)
+			{
+				region.FillChunk(chunkIndex, ReadRegionData<Region::BlockEntry>(data, offset));
+				continue;
+			}
+			
+			//Non uniform chunks are stored as their zlib compressed blocks, prefixed by the compressed size.
+			const uint32_t compressedSize = ReadRegionData<uint32_t>(data, offset);
+			if (offset + compressedSize > static_cast<size_t>(data.size()))
+			{
+				throw std::runtime_error("Invalid region data.");
+			}
 			
-			for (uint8_t i = 0; i < chunkCount; i++)
+			uLongf blocksSize = ChunkStorage::BlockCount * sizeof(Region::BlockEntry);
+			if (uncompress(reinterpret_cast<Bytef*>(ioBuffers.m_blocks.data()), &blocksSize, data.data() + offset,
+			               compressedSize) != Z_OK ||
+			    blocksSize != ChunkStorage::BlockCount * sizeof(Region::BlockEntry))
 			{
-				region.ReadChunk(chunkIndices[i], stream);
+				throw std::runtime_error("Invalid region data.");
 			}
+			offset += compressedSize;
+			
+			region.ReadChunk(chunkIndex, ioBuffers.m_blocks);
 		}
+		
+		region.UpdateHeightMaps();
+		
+		//The region now matches the serialized data.
+		region.ClearDirtyChunks();
 	}
 	
 	void World::SaveRegion(const Region& region)
 	{
-		std::ofstream stream(GetRegionPath(region.GetX(), region.GetZ()), std::ios::binary);
-		
-		stream.write(RegionMagic, sizeof(RegionMagic));
+		SaveRegion(region, ioBuffers.m_regionData);
+	}
+	
+	void World::SaveRegion(const Region& region, std::vector<uint8_t>& data)
+	{
+		//The dirty bits are cleared before the region is read, so that modifications made while it is being saved
+		//mark it as dirty again. They are restored if saving fails.
+		const uint32_t dirtyChunks = region.ClearDirtyChunks();
+		try
+		{
+			//The region is serialized to memory first, so that it is written to its container with a single write.
+			SerializeRegion(region, data);
+			StoreRegion({ region.GetX(), region.GetZ() }, data);
+		}
+		catch (...)
+		{
+			region.MarkChunksDirty(dirtyChunks);
+			throw;
+		}
+	}
+	
+	void World::SerializeRegion(const Region& region, std::vector<uint8_t>& data)
+	{
+		RegionHeader header;
+		std::copy(MAKE_RANGE(RegionMagic), header.m_magic);
+		header.m_version = RegionVersion;
+		header.m_chunkCount = 0;
 		
 		uint8_t chunkIndices[Region::ChunkCount];
-		uint8_t numChunkIndices = 0;
 		
 		for (uint8_t i = 0; i < Region::ChunkCount; i++)
 		{
 			if (region.IsChunkAir(i))
 				continue;
-			chunkIndices[numChunkIndices++] = i;
+			chunkIndices[header.m_chunkCount++] = region.GetChunk(i).IsUniform() ? (i | UniformChunkFlag) : i;
+		}
+		
+		data.clear();
+		WriteRegionData(data, &header, sizeof(header));
+		WriteRegionData(data, chunkIndices, header.m_chunkCount * sizeof(uint8_t));
+		
+		ioBuffers.m_blocks.resize(ChunkStorage::BlockCount);
+		
+		for (uint8_t i = 0; i < header.m_chunkCount; i++)
+		{
+			const uint32_t chunkIndex = chunkIndices[i] & ~UniformChunkFlag;
+			if (chunkIndices[i] & UniformChunkFlag)
+			{
+				const Region::BlockEntry entry = region.GetChunk(chunkIndex).GetUniformEntry();
+				WriteRegionData(data, &entry, sizeof(entry));
+				continue;
+			}
+			
+			region.WriteChunk(chunkIndex, ioBuffers.m_blocks);
+			
+			//Compresses directly into the region data, after space for the compressed size.
+			const uLong blocksSize = ChunkStorage::BlockCount * sizeof(Region::BlockEntry);
+			const size_t sizeOffset = data.size();
+			uLongf compressedSize = compressBound(blocksSize);
+			data.resize(sizeOffset + sizeof(uint32_t) + compressedSize);
+			
+			//Favors speed over size, since regions are saved while the game is running.
+			if (compress2(data.data() + sizeOffset + sizeof(uint32_t), &compressedSize,
+			              reinterpret_cast<const Bytef*>(ioBuffers.m_blocks.data()), blocksSize, Z_BEST_SPEED) != Z_OK)
+			{
+				throw std::runtime_error("Failed to compress chunk.");
+			}
+			
+			const uint32_t compressedSize32 = static_cast<uint32_t>(compressedSize);
+			std::memcpy(data.data() + sizeOffset, &compressedSize32, sizeof(uint32_t));
+			data.resize(sizeOffset + sizeof(uint32_t) + compressedSize);
+		}
+	}
+		
+	void World::StoreRegion(RegionCoordinate coordinate, gsl::span<const uint8_t> data)
+	{
+		std::shared_ptr<RegionContainer> container = GetContainer(coordinate.x, coordinate.z, true);
+		container->Write(RegionContainer::GetSlot(coordinate.x, coordinate.z), data);
+		
+		//The region is stored before the coordinate is added, so the index never refers to a missing region.
+		if (m_regionIndex.Insert(coordinate))
+		{
+			std::lock_guard<std::mutex> lock(m_indexStreamMutex);
+			m_indexStream.write(reinterpret_cast<const char*>(&coordinate), sizeof(coordinate));
+			m_indexStream.flush();
+		}
+	}
+	
+	void World::CompactContainers(const fs::path& dirPath)
+	{
+		uintmax_t bytesBefore = 0;
+		uintmax_t bytesAfter = 0;
+		uint32_t numCompacted = 0;
+		
+		for (const fs::directory_entry& entry : fs::directory_iterator(dirPath))
+		{
+			RegionCoordinate containerCoordinate;
+			if (!ParseContainerPath(entry.path(), containerCoordinate))
+				continue;
+			
+			RegionContainer container(entry.path());
+			bytesBefore += container.GetFileSize();
+			
+			if (container.GetUnusedSectors() != 0)
+			{
+				container.Compact();
+				numCompacted++;
+			}
+			
+			bytesAfter += container.GetFileSize();
 		}
 		
-		stream.write(reinterpret_cast<const char*>(&numChunkIndices), sizeof(numChunkIndices));
-		stream.write(reinterpret_cast<const char*>(chunkIndices), numChunkIndices * sizeof(uint8_t));
+		Log("Compacted ", numCompacted, " region containers, ", bytesBefore / 1024, " KiB -> ", bytesAfter / 1024,
+		    " KiB.");
+	}
+	
+	//Reads the saved data of regions with blocking reads, or through ring if it isn't null. If cold is true, the
+	//containers are dropped from the page cache first. Returns the throughput in MiB/s.
+	static double MeasureReadThroughput(World& world, const std::vector<RegionCoordinate>& coordinates,
+	                                    RegionReadRing* ring, bool cold)
+	{
+		constexpr uint32_t MaxReadsInFlight = 64;
+		
+		std::vector<std::shared_ptr<RegionContainer>> containers(coordinates.size());
+		std::vector<RegionContainer::DataLocation> locations(coordinates.size());
+		uint64_t totalBytes = 0;
+		for (size_t i = 0; i < coordinates.size(); i++)
+		{
+			containers[i] = world.GetRegionLocation(coordinates[i].x, coordinates[i].z, locations[i]);
+			totalBytes += locations[i].m_length;
+			
+			if (cold)
+				containers[i]->DropPageCache();
+		}
+		
+		std::vector<std::vector<uint8_t>> data(coordinates.size());
+		
+		auto startTime = std::chrono::high_resolution_clock::now();
+		
+		if (ring == nullptr)
+		{
+			for (size_t i = 0; i < coordinates.size(); i++)
+			{
+				containers[i]->Read(RegionContainer::GetSlot(coordinates[i].x, coordinates[i].z), data[i]);
+			}
+		}
+		else
+		{
+			std::vector<RegionReadRing::Completion> completions;
+			size_t numSubmitted = 0;
+			size_t numCompleted = 0;
+			while (numCompleted < coordinates.size())
+			{
+				while (numSubmitted < coordinates.size() && numSubmitted - numCompleted < MaxReadsInFlight)
+				{
+					data[numSubmitted].resize(locations[numSubmitted].m_length);
+					ring->QueueRead(containers[numSubmitted]->GetFileHandle(), locations[numSubmitted].m_offset,
+					                data[numSubmitted].data(), locations[numSubmitted].m_length, numSubmitted);
+					numSubmitted++;
+				}
+				ring->Submit();
+				
+				ring->WaitCompletions(completions);
+				numCompleted += completions.size();
+			}
+		}
+		
+		const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+		return totalBytes / (1024.0 * 1024.0) / elapsed.count();
+	}
+	
+	void World::BenchmarkRegionIO(uint32_t numRegions)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		
+		const fs::path benchmarkPath = fs::temp_directory_path() / "mcr-io-benchmark";
+		fs::remove_all(benchmarkPath);
+		fs::create_directories(benchmarkPath);
 		
-		for (uint8_t i = 0; i < numChunkIndices; i++)
+		WorldGenerator generator;
+		World world(benchmarkPath);
+		
+		std::vector<std::unique_ptr<Region>> regions;
+		std::chrono::duration<double, std::milli> generateTime(0);
+		std::chrono::duration<double, std::milli> saveTime(0);
+		std::chrono::duration<double, std::milli> loadTime(0);
+		
+		//Generates and saves a square of regions.
+		const int64_t sideLength = std::max(static_cast<int64_t>(std::sqrt(numRegions)), static_cast<int64_t>(1));
+		for (uint32_t i = 0; i < numRegions; i++)
+		{
+			regions.push_back(std::make_unique<Region>(i % sideLength, i / sideLength));
+			
+			auto startTime = Clock::now();
+			generator.Generate(*regions.back());
+			regions.back()->Compact();
+			auto generateEndTime = Clock::now();
+			world.SaveRegion(*regions.back());
+			
+			generateTime += generateEndTime - startTime;
+			saveTime += Clock::now() - generateEndTime;
+		}
+		
+		//Loads the regions back and compares them to the generated regions.
+		uint32_t mismatches = 0;
+		Region loadedRegion;
+		for (const std::unique_ptr<Region>& region : regions)
 		{
-			region.WriteChunk(chunkIndices[i], stream);
+			auto startTime = Clock::now();
+			loadedRegion.Reset(region->GetX(), region->GetZ());
+			world.LoadRegion(loadedRegion);
+			loadTime += Clock::now() - startTime;
+			
+			for (int y = 0; y < Region::Height; y++)
+			{
+				for (int z = 0; z < Region::Size; z++)
+				{
+					for (int x = 0; x < Region::Size; x++)
+					{
+						if (region->Get(x, y, z) != loadedRegion.Get(x, y, z))
+							mismatches++;
+					}
+				}
+			}
 		}
+
+		//Compares the throughput of reading the saved data with blocking reads and through io_uring, with the data
+		//in the page cache (warm) and read from disk (cold).
+		std::vector<RegionCoordinate> coordinates;
+		for (const std::unique_ptr<Region>& region : regions)
+		{
+			coordinates.push_back({ region->GetX(), region->GetZ() });
+		}
+		
+		const double blockingColdMiBs = MeasureReadThroughput(world, coordinates, nullptr, true);
+		const double blockingWarmMiBs = MeasureReadThroughput(world, coordinates, nullptr, false);
+		Log("Region read benchmark, blocking: ", blockingColdMiBs, " MiB/s cold, ", blockingWarmMiBs, " MiB/s warm.");
+		
+		if (std::unique_ptr<RegionReadRing> ring = RegionReadRing::Create(64))
+		{
+			const double ringColdMiBs = MeasureReadThroughput(world, coordinates, ring.get(), true);
+			const double ringWarmMiBs = MeasureReadThroughput(world, coordinates, ring.get(), false);
+			Log("Region read benchmark, io_uring: ", ringColdMiBs, " MiB/s cold, ", ringWarmMiBs, " MiB/s warm.");
+		}
+		else
+		{
+			Log("Region read benchmark, io_uring: not available.");
+		}
+		
+		uintmax_t fileBytes = 0;
+		for (const fs::directory_entry& entry : fs::directory_iterator(benchmarkPath))
+		{
+			fileBytes += fs::file_size(entry.path());
+		}
+		fs::remove_all(benchmarkPath);
+		
+		Log("Region IO benchmark: ", numRegions, " regions, ", mismatches, " mismatched blocks. Generate: ",
+		    generateTime.count() / numRegions, "ms/region, save: ", saveTime.count() / numRegions, "ms/region, load: ",
+		    loadTime.count() / numRegions, "ms/region, ", fileBytes / numRegions / 1024, " KiB/region on disk.");
 	}
 }
@@ -2,15 +2,19 @@
 
 #include <fstream>
 #include <optional>
+#include <unordered_map>
+#include <mutex>
 
 #include "region.h"
+#include "regionindex.h"
+#include "regioncontainer.h"
 #include "../filesystem.h"
 
 namespace MCR
 {
 	/*
-		HasRegion is internally synchronized and can be called async with LoadRegion and SaveRegion.
-		LoadRegion and SaveRegion must only be called from one thread at a time.
+		HasRegion, LoadRegion and SaveRegion are internally synchronized and can be called from multiple threads at
+		once. A region must not be loaded or saved by more than one thread at a time.
 	*/
 	class World final
 	{
@@ -23,15 +27,52 @@ namespace MCR
 		
 		void LoadRegion(Region& region);
 		
+		//Finds the data of a saved region so that it can be read without going through LoadRegion. Returns the
+		//container holding the data, which must be kept alive until the read is done, or null if the region isn't
+		//saved.
+		std::shared_ptr<RegionContainer> GetRegionLocation(int64_t x, int64_t z,
+		                                                   RegionContainer::DataLocation& location);
+		
+		//Saves a region and clears its dirty chunks, see Region::IsDirty.
 		void SaveRegion(const Region& region);
 		
+		//Saves a region, leaving its serialized data in data.
+		void SaveRegion(const Region& region, std::vector<uint8_t>& data);
+		
+		//Converts a region to or from the compressed form it is saved in. Deserializing clears the region's dirty
+		//chunks, the region must be empty beforehand.
+		static void SerializeRegion(const Region& region, std::vector<uint8_t>& data);
+		static void DeserializeRegion(Region& region, gsl::span<const uint8_t> data);
+		
+		//Generates regions, saves them to a temporary world and loads them back. Logs the time taken by each step per
+		//region, along with the number of blocks which differ after loading.
+		static void BenchmarkRegionIO(uint32_t numRegions);
+		
+		//Compacts every region container in a world directory which has unused sectors. Must not be called while the
+		//world is open.
+		static void CompactContainers(const fs::path& dirPath);
+		
 	private:
-		inline std::string GetRegionPath(int64_t x, int64_t z);
+		//Writes serialized region data to the region's container and adds the region to the index.
+		void StoreRegion(RegionCoordinate coordinate, gsl::span<const uint8_t> data);
+		
+		//Returns the container which holds the given region, opening it if needed. If create is false and the
+		//container doesn't exist, returns null instead of creating it.
+		std::shared_ptr<RegionContainer> GetContainer(int64_t x, int64_t z, bool create);
+		
+		//Fills the region index from the index file, or by scanning the world directory if there is no index file.
+		void LoadRegionIndex();
 		
 		fs::path m_path;
 		
-		std::mutex m_regionsMutex;
-		std::vector<RegionCoordinate> m_regions;
+		//The coordinates of all saved regions. These are also stored in the index file, which new regions are
+		//appended to as they are saved, so that opening a world doesn't have to look at every region file.
+		RegionIndex m_regionIndex;
+		std::mutex m_indexStreamMutex;
+		std::ofstream m_indexStream;
+		
+		std::mutex m_containersMutex;
+		std::unordered_map<RegionCoordinate, std::shared_ptr<RegionContainer>, RegionCoordinateHash> m_containers;
 		
 		glm::vec3 m_cameraPosition;
 		glm::vec2 m_cameraRotation;
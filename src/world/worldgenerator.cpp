@@ -1,8 +1,9 @@
 #include "worldgenerator.h"
-#include "worldmanager.h"
+#include "densityfield.h"
 #include "../blocks/ids.h"
 
 #include <random>
+#include <chrono>
 #include <glm/gtc/constants.hpp>
 
 namespace MCR
@@ -76,6 +77,9 @@ namespace MCR
 			cavePerlin.SetSeed(rand());
 		}
 		m_caveRadiusPerlin.SetSeed(rand());
+		
+		//Cached noise values were generated with the old seed.
+		m_noiseTiles.Clear();
 	}
 	
 	WorldGenerator::FutureRegion& WorldGenerator::FindFutureRegion(RegionCoordinate coordinate)
@@ -94,6 +98,9 @@ namespace MCR
 		return result;
 	}
 	
+	//World coordinates are divided by this before sampling noise.
+	const double perlinDiv = 25;
+	
 	//Average surface level Y-coordinate (in blocks).
 	const int averageSurfaceLevel = 150;
 	
@@ -278,50 +285,89 @@ namespace MCR
 		}
 	}
 	
+	WorldGenerator::GenerateJob::GenerateJob(Region& region, const PerlinNoise& heightPerlin, bool coarseDensity)
+	    : m_region(region), m_heightField(heightPerlin, perlinDiv, coarseDensity) { }
+	
 	void WorldGenerator::Generate(Region& region)
 	{
-		struct NeighborBlockPlacement
+		std::unique_ptr<GenerateJob> job = BeginGenerate(region);
+		
+		for (uint32_t i = 0; i < GenerateJob::NumTiles; i++)
 		{
-			int64_t m_x;
-			uint8_t m_y;
-			int64_t m_z;
-			Region::BlockEntry m_block;
-		};
+			GenerateTile(*job, i);
+		}
 		
-		std::vector<NeighborBlockPlacement> nBlockPlacements;
+		FinishGenerate(*job);
+	}
+	
+	std::unique_ptr<WorldGenerator::GenerateJob> WorldGenerator::BeginGenerate(Region& region)
+	{
+		std::unique_ptr<GenerateJob> job(new GenerateJob(region, m_heightPerlin, m_coarseDensity));
 		
-		std::subtract_with_carry_engine<uint64_t, 48, 5, 12> randEngine(region.GetX() ^ bswap_64(region.GetZ()));
+		//The terrain of each column is generated into job->m_columns and then written to the region in one go.
+		job->m_terrainMaxY = static_cast<int>(std::ceil(averageSurfaceLevel + maxSurfaceLevelRange));
+		job->m_columnHeight = std::min(job->m_terrainMaxY + 2, static_cast<int>(Region::Height));
+		job->m_columns.resize(static_cast<size_t>(Region::Size * Region::Size * job->m_columnHeight));
 		
-		const double PerlinDiv = 25;
+		job->m_heightField.SetRegion(region.GetX(), region.GetZ(), job->m_terrainMaxY);
 		
+		//The 2D noises are evaluated for the whole region at once and kept in the noise tile cache.
 		const int64_t regionMinX = region.GetX() * Region::Size;
 		const int64_t regionMinZ = region.GetZ() * Region::Size;
+		for (int i = 0; i < Region::Size; i++)
+		{
+			job->m_slabXs[i] = (regionMinX + i) / perlinDiv;
+			job->m_slabZs[i] = (regionMinZ + i) / perlinDiv;
+		}
 		
-		int surfaceHeights[Region::Size][Region::Size];
+		auto getNoiseTile = [&] (NoiseTileID noiseID, const PerlinNoise& perlin)
+		{
+			const RegionCoordinate coordinate = { region.GetX(), region.GetZ() };
+			return m_noiseTiles.Get(coordinate, static_cast<uint32_t>(noiseID), [&] (NoiseTileCache::Tile& tile)
+			{
+				perlin.FillSlab(job->m_slabXs.data(), Region::Size, 0, job->m_slabZs.data(), Region::Size,
+				                tile.data());
+			});
+		};
+		
+		job->m_oceanValues = getNoiseTile(NoiseTileID::Ocean, m_oceanPerlin);
+		job->m_terraceValues = getNoiseTile(NoiseTileID::Terrace, m_terracePerlin);
+		job->m_roughnessValues = getNoiseTile(NoiseTileID::Roughness, m_roughnessPerlin);
+		job->m_fernValues = getNoiseTile(NoiseTileID::Fern, m_fernPerlin);
+		
+		return job;
+	}
+	
+	void WorldGenerator::GenerateTile(GenerateJob& job, uint32_t tileIndex) const
+	{
+		constexpr int tilesPerRow = Region::Size / GenerateJob::TileSize;
+		const int tileMinX = static_cast<int>(tileIndex % tilesPerRow) * GenerateJob::TileSize;
+		const int tileMinZ = static_cast<int>(tileIndex / tilesPerRow) * GenerateJob::TileSize;
+		
+		std::array<double, Region::Height> heightColumn;
 		
 		// ** Generates basic terrain **
-		for (int lz = 0; lz < Region::Size; lz++)
+		for (int lz = tileMinZ; lz < tileMinZ + GenerateJob::TileSize; lz++)
 		{
-			int64_t z = lz + region.GetZ() * Region::Size;
-			double pz = z / PerlinDiv;
+			double pz = job.m_slabZs[lz];
 			
-			for (int lx = 0; lx < Region::Size; lx++)
+			for (int lx = tileMinX; lx < tileMinX + GenerateJob::TileSize; lx++)
 			{
-				int64_t x = lx + region.GetX() * Region::Size;
-				double px = x / PerlinDiv;
+				double px = job.m_slabXs[lx];
+				const int slabIndex = lz * Region::Size + lx;
 				
-				double oceanProgress = m_oceanPerlin.GetValue(px, 0, pz);
+				double oceanProgress = (*job.m_oceanValues)[slabIndex];
 				const bool isOcean = oceanProgress > 0.0;
 				float oceanProgressSat = static_cast<float>(glm::clamp(oceanProgress * 5, 0.0, 1.0));
 				
 				int blocksSinceAir = 0;
 				
 				// ** Calculates the terrace offset **
-				double terraceVal = (m_terracePerlin.GetValue(px, 0, pz) * 0.5 + 0.5) * terraceCount;
+				double terraceVal = ((*job.m_terraceValues)[slabIndex] * 0.5 + 0.5) * terraceCount;
 				const double heightCurrentTerrace = glm::clamp(terraceSlope * (glm::fract(terraceVal) - 0.5) + 0.5, 0.0, 1.0);
 				double terraceOffset = (glm::floor(terraceVal) + heightCurrentTerrace - (terraceCount / 2.0)) * terraceHeight;
 				
-				double roughness = m_roughnessPerlin.GetValue(px, 0, pz) * 0.5 + 0.5;
+				double roughness = (*job.m_roughnessValues)[slabIndex] * 0.5 + 0.5;
 				const double oceanRoughnessRedBegin = -0.25;
 				if (oceanProgress > oceanRoughnessRedBegin)
 				{
@@ -333,18 +379,23 @@ namespace MCR
 				
 				double surfaceLevelRange = glm::mix(minSurfaceLevelRange, maxSurfaceLevelRange, roughness);
 				
-				bool hasFern = m_fernPerlin.GetValue(px, 0, pz) > 0.0;
+				bool hasFern = (*job.m_fernValues)[slabIndex] > 0.0;
 				
-				surfaceHeights[lx][lz] = 0;
+				job.m_surfaceHeights[lx][lz] = 0;
 				
-				for (int y = static_cast<int>(std::ceil(averageSurfaceLevel + maxSurfaceLevelRange)); y > 0; y--)
+				Region::BlockEntry* column = &job.m_columns[slabIndex * job.m_columnHeight];
+				std::fill(column, column + job.m_columnHeight, Region::BlockEntry { BlockIDs::Air });
+				
+				job.m_heightField.GetColumn(lx, lz, heightColumn.data());
+				
+				for (int y = job.m_terrainMaxY; y > 0; y--)
 				{
 					Region::BlockEntry block;
 					block.m_data = 0;
 					
-					double py = y / PerlinDiv;
+					double py = y / perlinDiv;
 					
-					double heightVal = m_heightPerlin.GetValue(px, py, pz);
+					double heightVal = heightColumn[y];
 					heightVal += glm::mix((y - (averageSurfaceLevel + terraceOffset)),
 					                      (y - (seaLevel - maxOceanDepth)),
 					                      oceanProgressSat) / surfaceLevelRange;
@@ -374,9 +425,9 @@ namespace MCR
 						}
 						else if (blocksSinceAir == 0)
 						{
-							if (surfaceHeights[lx][lz] == 0)
+							if (job.m_surfaceHeights[lx][lz] == 0)
 							{
-								surfaceHeights[lx][lz] = y;
+								job.m_surfaceHeights[lx][lz] = y;
 							}
 							
 							block.m_id = BlockIDs::Grass;
@@ -385,7 +436,7 @@ namespace MCR
 							{
 								if (hasFern)
 								{
-									region.Set(lx, y + 1, lz, { BlockIDs::Fern });
+									column[y + 1] = { BlockIDs::Fern };
 								}
 								else
 								{
@@ -395,7 +446,7 @@ namespace MCR
 									{
 										double flowerIndexD = std::floor(flowerVal / flowerFrequency * ArrayLength(flowerIDs));
 										
-										region.Set(lx, y + 1, lz, { flowerIDs[static_cast<int>(flowerIndexD)] });
+										column[y + 1] = { flowerIDs[static_cast<int>(flowerIndexD)] };
 									}
 								}
 							}
@@ -408,10 +459,41 @@ namespace MCR
 						blocksSinceAir++;
 					}
 					
-					region.Set(lx, y, lz, block);
+					column[y] = block;
 				}
 				
-				region.Set(lx, 0, lz, { BlockIDs::Bedrock });
+				column[0] = { BlockIDs::Bedrock };
+			}
+		}
+	}
+	
+	void WorldGenerator::FinishGenerate(GenerateJob& job)
+	{
+		struct NeighborBlockPlacement
+		{
+			int64_t m_x;
+			uint8_t m_y;
+			int64_t m_z;
+			Region::BlockEntry m_block;
+		};
+		
+		std::vector<NeighborBlockPlacement> nBlockPlacements;
+		
+		Region& region = job.m_region;
+		auto& surfaceHeights = job.m_surfaceHeights;
+		
+		std::subtract_with_carry_engine<uint64_t, 48, 5, 12> randEngine(region.GetX() ^ bswap_64(region.GetZ()));
+		
+		const int64_t regionMinX = region.GetX() * Region::Size;
+		const int64_t regionMinZ = region.GetZ() * Region::Size;
+		
+		// ** Writes the terrain generated by the tiles **
+		for (int lz = 0; lz < Region::Size; lz++)
+		{
+			for (int lx = 0; lx < Region::Size; lx++)
+			{
+				const Region::BlockEntry* column = &job.m_columns[(lz * Region::Size + lx) * job.m_columnHeight];
+				region.WriteColumn(lx, lz, 0, gsl::span<const Region::BlockEntry>(column, job.m_columnHeight));
 			}
 		}
 		
@@ -426,19 +508,21 @@ namespace MCR
 			{
 				const glm::ivec3 origin(orePosXZDist(randEngine), yPositionDist(randEngine), orePosXZDist(randEngine));
 				
-				for (int y = 0; y < 2; y++)
+				for (int z = 0; z < 2; z++)
 				{
-					for (int z = 0; z < 2; z++)
+					for (int x = 0; x < 2; x++)
 					{
-						for (int x = 0; x < 2; x++)
+						Region::BlockEntry oreColumn[2];
+						for (int y = 0; y < 2; y++)
 						{
-							glm::ivec3 blockPos = origin + glm::ivec3(x, y, z);
-							
-							if (region.Get(blockPos).m_id == BlockIDs::Stone)
+							oreColumn[y] = region.Get(origin.x + x, origin.y + y, origin.z + z);
+							if (oreColumn[y].m_id == BlockIDs::Stone)
 							{
-								region.Set(blockPos, { oreIDs[i] });
+								oreColumn[y] = { oreIDs[i] };
 							}
 						}
+						
+						region.WriteColumn(origin.x + x, origin.z + z, origin.y, oreColumn);
 					}
 				}
 			}
@@ -482,7 +566,7 @@ namespace MCR
 				std::uniform_int_distribution<int> offsetDist(rad, gridSize - rad - 1);
 				int offsetX = offsetDist(randEngine);
 				int offsetZ = offsetDist(randEngine);
-				
+			
 			calculateLocalOrigin:
 				int originX = tx * gridSize - regionMinX + offsetX;
 				int originZ = tz * gridSize - regionMinZ + offsetZ;
@@ -501,12 +585,13 @@ namespace MCR
 				const int height = spruceHeightDist(randEngine);
 				const int leafBeginY = std::round(height * spruceLeafBeginHeight);
 				
+				region.FillColumn(originX, originZ, surfaceHeights[originX][originZ] + 1,
+				                  surfaceHeights[originX][originZ] + height + 1, { BlockIDs::SpruceWood });
+				
 				for (int y = 1; y <= height; y++)
 				{
 					int regionY = surfaceHeights[originX][originZ] + y;
 					
-					region.Set(originX, regionY, originZ, { BlockIDs::SpruceWood });
-					
 					if (y >= leafBeginY)
 					{
 						double leafRad = (1.0 - (y - leafBeginY) / static_cast<double>(height - leafBeginY)) * rad;
@@ -532,7 +617,7 @@ namespace MCR
 								
 								if (lx >= 0 && lz >= 0 && lx < Region::Size && lz < Region::Size)
 								{
-									region.Set(lx, regionY, lz, { BlockIDs::SpruceLeaves });
+									region.FillColumn(lx, lz, regionY, regionY + 1, { BlockIDs::SpruceLeaves });
 								}
 								else
 								{
@@ -546,6 +631,8 @@ namespace MCR
 			}
 		}
 		
+		region.UpdateStaleChunks();
+		
 		std::unique_lock<std::mutex> futureRegionsLock(m_futureRegionsMutex);
 		
 		for (const NeighborBlockPlacement& blockPlacement : nBlockPlacements)
@@ -579,13 +666,14 @@ namespace MCR
 		}
 	}
 	
-	void WorldGenerator::ProcessFutureRegions(WorldManager& worldManager)
+	void WorldGenerator::ProcessFutureRegions(const std::function<Region*(RegionCoordinate)>& getRegion,
+	                                          const std::function<void(RegionCoordinate)>& regionModified)
 	{
 		std::unique_lock<std::mutex> lock(m_futureRegionsMutex);
 		
 		for (size_t i = 0; i < m_futureRegions.size();)
 		{
-			Region* region = worldManager.GetRegion(m_futureRegions[i].m_coordinate);
+			Region* region = getRegion(m_futureRegions[i].m_coordinate);
 			
 			if (region == nullptr)
 			{
@@ -605,20 +693,81 @@ namespace MCR
 			
 			ProcessFutureRegion(futureRegion, *region);
 			
-			const glm::ivec2 neighbors[] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+			regionModified(futureRegion.m_coordinate);
+			
+			lock.lock();
+		}
+	}
+	
+	//Returns the y-coordinate of the highest block in a column which isn't air or water, or 0 if there is none.
+	static int GetSurfaceHeight(const Region& region, int lx, int lz)
+	{
+		for (int y = Region::Height - 1; y > 0; y--)
+		{
+			const uint8_t id = region.Get(lx, y, lz).m_id;
+			if (id != BlockIDs::Air && id != BlockIDs::Water)
+				return y;
+		}
+		return 0;
+	}
+	
+	void WorldGenerator::CompareDensitySampling(uint32_t numRegions)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		
+		WorldGenerator exactGenerator;
+		WorldGenerator coarseGenerator;
+		coarseGenerator.SetCoarseDensity(true);
+		
+		std::chrono::duration<double, std::milli> exactTime(0);
+		std::chrono::duration<double, std::milli> coarseTime(0);
+		
+		uint64_t numDifferentBlocks = 0;
+		uint64_t surfaceHeightDiffSum = 0;
+		int maxSurfaceHeightDiff = 0;
+		uint32_t numDifferentSurfaces = 0;
+		
+		//Generates a square of regions, so that blocks placed across region borders are included.
+		const int64_t sideLength = std::max(static_cast<int64_t>(std::sqrt(numRegions)), static_cast<int64_t>(1));
+		for (uint32_t i = 0; i < numRegions; i++)
+		{
+			Region exactRegion(i % sideLength, i / sideLength);
+			Region coarseRegion(i % sideLength, i / sideLength);
+			
+			auto startTime = Clock::now();
+			exactGenerator.Generate(exactRegion);
+			auto exactEndTime = Clock::now();
+			coarseGenerator.Generate(coarseRegion);
+			
+			exactTime += exactEndTime - startTime;
+			coarseTime += Clock::now() - exactEndTime;
 			
-			for (uint32_t y = 0; y < Region::ChunkCount; y++)
+			for (int lz = 0; lz < Region::Size; lz++)
 			{
-				worldManager.MarkOutOfDate(futureRegion.m_coordinate, y);
-				
-				for (glm::ivec2 neighbor : neighbors)
+				for (int lx = 0; lx < Region::Size; lx++)
 				{
-					worldManager.MarkOutOfDate({ futureRegion.m_coordinate.x + neighbor.x,
-					                             futureRegion.m_coordinate.z + neighbor.y }, y);
+					for (int y = 0; y < Region::Height; y++)
+					{
+						if (exactRegion.Get(lx, y, lz) != coarseRegion.Get(lx, y, lz))
+							numDifferentBlocks++;
+					}
+					
+					const int surfaceHeightDiff = std::abs(GetSurfaceHeight(exactRegion, lx, lz) -
+					                                       GetSurfaceHeight(coarseRegion, lx, lz));
+					surfaceHeightDiffSum += surfaceHeightDiff;
+					maxSurfaceHeightDiff = std::max(maxSurfaceHeightDiff, surfaceHeightDiff);
+					if (surfaceHeightDiff != 0)
+						numDifferentSurfaces++;
 				}
 			}
-			
-			lock.lock();
 		}
+		
+		const double numColumns = static_cast<double>(numRegions) * Region::Size * Region::Size;
+		
+		Log("Density sampling, exact: ", exactTime.count() / numRegions, "ms/region, coarse: ",
+		    coarseTime.count() / numRegions, "ms/region (", exactTime.count() / coarseTime.count(), "x).");
+		Log("Density sampling, ", numDifferentBlocks * 100.0 / (numColumns * Region::Height), "% of blocks differ, ",
+		    numDifferentSurfaces * 100.0 / numColumns, "% of surface heights differ, mean surface height difference ",
+		    surfaceHeightDiffSum / numColumns, ", max ", maxSurfaceHeightDiff, ".");
 	}
 }
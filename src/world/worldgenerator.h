@@ -3,8 +3,13 @@
 #include <libnoise/module/perlin.h>
 #include <libnoise/module/ridgedmulti.h>
 #include <functional>
+#include <atomic>
+#include <memory>
 
 #include "region.h"
+#include "perlinnoise.h"
+#include "noisetilecache.h"
+#include "densityfield.h"
 
 namespace MCR
 {
@@ -15,9 +20,99 @@ namespace MCR
 		
 		void SetSeed(int seed);
 		
+		//The state of a region which is being generated in parts. The terrain is generated in tiles of columns which
+		//can be generated on different threads, after which the rest of the region is generated by FinishGenerate.
+		class GenerateJob
+		{
+		public:
+			static constexpr int TileSize = 8;
+			static constexpr uint32_t NumTiles = (Region::Size / TileSize) * (Region::Size / TileSize);
+			
+			inline Region& GetRegion() const
+			{
+				return m_region;
+			}
+			
+		private:
+			friend class WorldGenerator;
+			
+			GenerateJob(Region& region, const PerlinNoise& heightPerlin, bool coarseDensity);
+			
+			Region& m_region;
+			
+			int m_terrainMaxY;
+			int m_columnHeight;
+			
+			DensityField m_heightField;
+			
+			std::array<double, Region::Size> m_slabXs;
+			std::array<double, Region::Size> m_slabZs;
+			
+			//2D noise values indexed by lz * Region::Size + lx.
+			std::shared_ptr<const NoiseTileCache::Tile> m_oceanValues;
+			std::shared_ptr<const NoiseTileCache::Tile> m_terraceValues;
+			std::shared_ptr<const NoiseTileCache::Tile> m_roughnessValues;
+			std::shared_ptr<const NoiseTileCache::Tile> m_fernValues;
+			
+			int m_surfaceHeights[Region::Size][Region::Size];
+			
+			//The generated terrain, m_columnHeight blocks for each column indexed by lz * Region::Size + lx.
+			std::vector<Region::BlockEntry> m_columns;
+		};
+		
+		//Generates a region on the calling thread, the same as running all the steps of a GenerateJob.
 		void Generate(Region& region);
 		
-		void ProcessFutureRegions(class WorldManager& worldManager);
+		//Starts generating a region, evaluating the noises which are shared by all tiles.
+		std::unique_ptr<GenerateJob> BeginGenerate(Region& region);
+		
+		//Generates the terrain of one tile. Different tiles of a job can be generated at the same time.
+		void GenerateTile(GenerateJob& job, uint32_t tileIndex) const;
+		
+		//Writes the terrain to the region and adds ores, caves and trees. Must be called once all tiles have been
+		//generated.
+		void FinishGenerate(GenerateJob& job);
+		
+		//Samples the terrain density on a coarse lattice instead of at every block, see DensityField. Regions
+		//generated with and without coarse density differ slightly, so this should not be changed for an existing
+		//world. Can be called while regions are being generated.
+		inline void SetCoarseDensity(bool coarseDensity)
+		{
+			m_coarseDensity = coarseDensity;
+		}
+		
+		inline bool IsCoarseDensityEnabled() const
+		{
+			return m_coarseDensity;
+		}
+		
+		//Generates regions with exact and coarse density sampling, and logs the time taken by each along with how
+		//much the generated terrain differs.
+		static void CompareDensitySampling(uint32_t numRegions);
+		
+		//The cache of 2D noise values shared by all threads generating regions with this generator.
+		inline const NoiseTileCache& GetNoiseTileCache() const
+		{
+			return m_noiseTiles;
+		}
+		
+		//The noise tile cache only helps when regions are generated more than once, so it is disabled by default.
+		inline void SetNoiseTileCacheEnabled(bool enabled)
+		{
+			m_noiseTiles.SetCapacity(enabled ? NoiseTileCacheCapacity : 0);
+		}
+		
+		inline bool IsNoiseTileCacheEnabled() const
+		{
+			return m_noiseTiles.GetCapacity() != 0;
+		}
+		
+		//Applies blocks placed outside of the region they were generated for (leaves and caves crossing region
+		//borders) to regions which have already been generated. getRegion returns null for regions which aren't
+		//available, their placements are kept until the region is generated or becomes available. regionModified is
+		//called with the coordinate of each region which was changed.
+		void ProcessFutureRegions(const std::function<Region*(RegionCoordinate)>& getRegion,
+		                          const std::function<void(RegionCoordinate)>& regionModified);
 		
 	private:
 		struct CaveWorm
@@ -43,21 +138,37 @@ namespace MCR
 			std::vector<FutureBlockPlacement> m_blockPlacements;
 		};
 		
+		//Identifies the 2D noises in the noise tile cache.
+		enum class NoiseTileID : uint32_t
+		{
+			Ocean,
+			Terrace,
+			Roughness,
+			Fern
+		};
+		
+		//Enough tiles for the 2D noises of 1024 regions, 32 MiB, when the noise tile cache is enabled.
+		static constexpr size_t NoiseTileCacheCapacity = 4096;
+		
 		void ProcessCaveWorm(CaveWorm worm, Region& region);
 		
 		void ProcessFutureRegion(const FutureRegion& futureRegion, Region& region);
 		
 		FutureRegion& FindFutureRegion(RegionCoordinate coordinate);
 		
+		std::atomic<bool> m_coarseDensity { false };
+		
 		std::mutex m_futureRegionsMutex;
 		std::vector<FutureRegion> m_futureRegions;
 		
-		noise::module::Perlin m_roughnessPerlin;
-		noise::module::Perlin m_heightPerlin;
-		noise::module::Perlin m_oceanPerlin;
-		noise::module::Perlin m_terracePerlin;
-		noise::module::Perlin m_flowerPerlin;
-		noise::module::Perlin m_fernPerlin;
+		NoiseTileCache m_noiseTiles;
+		
+		PerlinNoise m_roughnessPerlin;
+		PerlinNoise m_heightPerlin;
+		PerlinNoise m_oceanPerlin;
+		PerlinNoise m_terracePerlin;
+		PerlinNoise m_flowerPerlin;
+		PerlinNoise m_fernPerlin;
 		noise::module::Perlin m_caveDirectionPerlin[3];
 		noise::module::Perlin m_caveRadiusPerlin;
 	};
@@ -4,18 +4,40 @@
 #include "../rendering/regions/buildchunkmesh.h"
 #include "../blocks/sides.h"
 #include "../blocks/ids.h"
+#include "../profiling/profiling.h"
 
 #include <gsl/gsl_util>
 
 namespace MCR
 {
+	constexpr bool enableIO = true;
+	
+	constexpr size_t defaultRegionCacheBytes = 32 * 1024 * 1024;
+	
+	//Most of the time spent loading and saving regions is (de)compression, which benefits from more than one thread.
+	constexpr size_t numIOThreads = 2;
+	
+	//How far ahead (in seconds) the camera's position is extrapolated when prefetching regions, and the maximum number
+	//of regions the prediction can be away from the camera along each axis.
+	constexpr float prefetchSeconds = 4.0f;
+	constexpr int64_t maxPrefetchDistance = 2;
+	
 	WorldManager::WorldManager()
-	    : m_generateThread(4)
+	    : m_regionCache(defaultRegionCacheBytes), m_generateThread(4, m_regionPool)
 	{
 		SetRenderDistance(8);
+		
+		//Regions are only generated more than once if they aren't saved when leaving the loaded area.
+		m_generateThread.GetGenerator().SetNoiseTileCacheEnabled(!enableIO);
 	}
 	
-	constexpr bool enableIO = false;
+	const glm::ivec2 regionNeighborDirs[] = 
+	{
+		/* NeighborPosX */  {  1, 0 },
+		/* NeighborNegX */  { -1, 0 },
+		/* NeighborPosZ */  { 0,  1 },
+		/* NeighborNegZ */  { 0, -1 }
+	};
 	
 	void WorldManager::SaveAll()
 	{
@@ -26,10 +48,18 @@ namespace MCR
 		
 		for (int i = m_regionTableSize * m_regionTableSize - 1; i >= 0; i--)
 		{
-			const RegionEntry* entry = m_regions[0][i];
-			if (entry != nullptr && entry->m_region)
+			const RegionEntry* entry = m_regions[i];
+			if (entry != nullptr && entry->m_region && entry->m_region->IsDirty())
 			{
-				m_ioThread->RegisterForSaving(entry->m_region);
+				m_ioThread->RegisterForSaving(entry->m_region, false);
+			}
+		}
+		
+		for (const auto& prefetchedRegion : m_prefetchedRegions)
+		{
+			if (prefetchedRegion.second->IsDirty())
+			{
+				m_ioThread->RegisterForSaving(prefetchedRegion.second, false);
 			}
 		}
 		
@@ -48,6 +78,16 @@ namespace MCR
 	{
 		m_hasUpdated = false;
 		
+		//The region table is rebuilt and every region is registered again, so regions waiting in the old table
+		//are freed to cancel their generation.
+		for (RegionEntry* entry : m_regions)
+		{
+			if (entry != nullptr)
+			{
+				FreeRegionEntry(entry);
+			}
+		}
+		
 		m_renderDistanceSq = renderDist * renderDist;
 		m_loadDistance = renderDist + 3;
 		
@@ -57,6 +97,10 @@ namespace MCR
 		//Allocates memory for the required number of regions.
 		m_regionsAllocation = std::make_unique<RegionEntry[]>(numRegionEntries);
 		
+		//Regions can still be referenced by the generate and IO threads after leaving the region table, so the pool
+		//keeps some extra regions around.
+		m_regionPool.SetCapacity(numRegionEntries * 2);
+		
 		//Fills the available regions list.
 		m_availableRegions.resize(numRegionEntries);
 		for (int i = 0; i < numRegionEntries; i++)
@@ -64,12 +108,9 @@ namespace MCR
 			m_availableRegions[i] = &m_regionsAllocation[i];
 		}
 		
-		//Initializes the region tables.
-		for (int i = 0; i < 2; i++)
-		{
-			m_regions[i].resize(numRegionEntries);
-			std::fill(MAKE_RANGE(m_regions[i]), nullptr);
-		}
+		//Initializes the region table.
+		m_regions.resize(numRegionEntries);
+		std::fill(MAKE_RANGE(m_regions), nullptr);
 	}
 	
 	void WorldManager::Update(float dt, const class InputState& inputState)
@@ -94,68 +135,106 @@ namespace MCR
 		
 		if (shifted)
 		{
-			//Saves and frees regions that have been shifted off the region table
-			//or moves the region to it's new location if hasn't been shifted off.
+			m_ioThread->BeginRegistering();
+			
+			//Saves and frees regions that have been shifted off the region table. Regions which remain on the table
+			//keep their slot in the ring, so they don't need to be moved.
 			if (m_hasUpdated)
 			{
-				for (int x = 0; x < m_regionTableSize; x++)
+				ForEachShiftedOff(shiftX, shiftZ, [&] (int x, int z)
 				{
-					for (int z = 0; z < m_regionTableSize; z++)
+					RegionEntry*& region = m_regions[GetRegionIndex(x, z)];
+					if (region == nullptr)
+						return;
+					
+					//Regions which haven't been modified since they were loaded or saved are up to date on disk,
+					//so they are only passed to the IO threads if they should be cached.
+					if (region->m_region && enableIO &&
+					    (region->m_region->IsDirty() || m_regionCache.GetCapacity() != 0))
 					{
-						int destIndex = GetRegionIndex(x + shiftX, z + shiftZ);
-						
-						RegionEntry* region = m_regions[0][GetRegionIndex(x, z)];
-						if (region == nullptr)
-							continue;
-						
-						if (destIndex == -1)
-						{
-							//This region has been pushed off the region table
-							if (region->m_region && enableIO)
-							{
-								m_ioThread->RegisterForSaving(std::move(region->m_region));
-							}
-							
-							FreeRegionEntry(region);
-						}
-						else
-						{
-							m_regions[1][destIndex] = region;
-						}
+						m_ioThread->RegisterForSaving(std::move(region->m_region), true);
 					}
-				}
+					
+					FreeRegionEntry(region);
+					region = nullptr;
+				});
 			}
 			
-			m_ioThread->BeginRegistering();
+			m_centerRegionX = currentRegionX;
+			m_centerRegionZ = currentRegionZ;
+			
+			auto GetRingOffset = [&] (int64_t minCoordinate)
+			{
+				const int offset = static_cast<int>(minCoordinate % m_regionTableSize);
+				return offset < 0 ? offset + m_regionTableSize : offset;
+			};
+			m_ringOffsetX = GetRingOffset(toGlobalX);
+			m_ringOffsetZ = GetRingOffset(toGlobalZ);
+			
 			m_generateThread.BeginRegistering();
 			
+			m_ioThread->SetLoadArea({ currentRegionX, currentRegionZ }, m_loadDistance);
 			m_generateThread.SetCameraRegion({ currentRegionX, currentRegionZ });
 			
+			auto LoadRegion = [&] (int x, int z)
+			{
+				const RegionCoordinate coordinate = { x + toGlobalX, z + toGlobalZ };
+				
+				RegionEntry* region = AllocateRegionEntry();
+				region->m_state = RegionStates::Loading;
+				
+				//Prefetched regions are used directly, and regions which are being prefetched are handed to their
+				//entry when they arrive. Prefetches which haven't started are moved to the regular queues, so that
+				//they don't wait behind all other loads.
+				auto prefetchedIt = m_prefetchedRegions.find(coordinate);
+				if (prefetchedIt != m_prefetchedRegions.end())
+				{
+					SetLoadedRegion(*region, std::move(prefetchedIt->second));
+					m_prefetchedRegions.erase(prefetchedIt);
+					m_numPrefetchHits++;
+				}
+				else if (m_prefetchesInProgress.count(coordinate) != 0)
+				{
+					bool promoted = enableIO && m_ioThread->PromotePrefetch(coordinate);
+					if (!promoted)
+					{
+						region->m_generateCancelToken = m_generateThread.PromotePrefetch(coordinate);
+						promoted = region->m_generateCancelToken != nullptr;
+					}
+					
+					if (promoted)
+					{
+						m_prefetchesInProgress.erase(coordinate);
+					}
+				}
+				//Regions waiting to be saved are loaded from the IO thread's in-flight table, even if they haven't
+				//been written to the world yet.
+				else if (enableIO &&
+				         (m_ioThread->IsInFlight(coordinate) || m_world->HasRegion(coordinate.x, coordinate.z)))
+				{
+					m_ioThread->RegisterForLoading(coordinate);
+				}
+				else
+				{
+					region->m_generateCancelToken = m_generateThread.Register(coordinate);
+				}
+				
+				m_regions[GetRegionIndex(x, z)] = region;
+			};
+			
 			//Loads/generates the region if it was previouly out of bounds or if this is the first update
 			//after changing world.
-			for (int x = 0; x < m_regionTableSize; x++)
+			if (m_hasUpdated)
 			{
-				for (int z = 0; z < m_regionTableSize; z++)
+				ForEachShiftedOff(-shiftX, -shiftZ, LoadRegion);
+			}
+			else
+			{
+				for (int x = 0; x < m_regionTableSize; x++)
 				{
-					int sourceIndex = GetRegionIndex(x, z);
-					
-					if (GetRegionIndex(x - shiftX, z - shiftZ) == -1 || !m_hasUpdated)
+					for (int z = 0; z < m_regionTableSize; z++)
 					{
-						const RegionCoordinate coordinate = { x + toGlobalX, z + toGlobalZ };
-						
-						RegionEntry* region = AllocateRegionEntry();
-						region->m_state = RegionStates::Loading;
-						
-						if (m_world->HasRegion(coordinate.x, coordinate.z) && enableIO)
-						{
-							m_ioThread->RegisterForLoading(coordinate);
-						}
-						else
-						{
-							m_generateThread.Register(coordinate);
-						}
-						
-						m_regions[1][sourceIndex] = region;
+						LoadRegion(x, z);
 					}
 				}
 			}
@@ -163,40 +242,66 @@ namespace MCR
 			m_ioThread->EndRegistering();
 			m_generateThread.EndRegistering();
 			
-			m_regions[0].swap(m_regions[1]);
-			m_centerRegionX = currentRegionX;
-			m_centerRegionZ = currentRegionZ;
-			
 			m_hasUpdated = true;
 		}
 		
-		//Processes loaded regions.
+		if (enableIO)
+		{
+			UpdatePrefetch(shifted);
+		}
+		
+		//Processes loaded regions. Prefetched regions which haven't entered the loaded area yet are kept until they do.
+		//A load or generation which was already running when its region left the loaded area can arrive after the
+		//region has entered it again and been loaded by another request, in which case it is ignored.
 		auto ProcessNewRegion = [&] (NewRegion& newRegion)
 		{
-			const int regTableX = gsl::narrow<int>(newRegion.m_region->GetX() - m_centerRegionX) + m_loadDistance;
-			const int regTableZ = gsl::narrow<int>(newRegion.m_region->GetZ() - m_centerRegionZ) + m_loadDistance;
-			const int regTableIndex = GetRegionIndex(regTableX, regTableZ);
+			const RegionCoordinate coordinate = { newRegion.m_region->GetX(), newRegion.m_region->GetZ() };
+			const bool prefetched = m_prefetchesInProgress.erase(coordinate) != 0;
 			
-			RegionEntry* regionEntry = regTableIndex == -1 ? nullptr : m_regions[0][regTableIndex];
+			RegionEntry* regionEntry = RegionEntryFromGlobalCoordinate(coordinate);
 			
 			if (regionEntry != nullptr)
 			{
-				for (uint32_t i = 0; i < Region::ChunkCount; i++)
+				if (regionEntry->m_region != nullptr)
+					return;
+				
+				SetLoadedRegion(*regionEntry, std::move(newRegion.m_region));
+				if (prefetched)
 				{
-					if (newRegion.m_region->ChunkHasWater(i))
-					{
-						m_outOfDateWaterList.push_back({{newRegion.m_region->GetX(), newRegion.m_region->GetZ()}, i});
-					}
+					m_numPrefetchHits++;
 				}
-				
-				regionEntry->m_state = RegionStates::LoadedNotBuilt;
-				regionEntry->m_region = std::move(newRegion.m_region);
+			}
+			else if (prefetched)
+			{
+				m_prefetchedRegions.emplace(coordinate, std::move(newRegion.m_region));
 			}
 		};
 		
 		if (enableIO)
 		{
 			m_ioThread->IterateLoadedRegions(ProcessNewRegion);
+			
+			//Regions which couldn't be loaded are generated instead.
+			std::vector<RegionCoordinate> failedLoads;
+			m_ioThread->IterateFailedLoads([&] (RegionCoordinate coordinate) { failedLoads.push_back(coordinate); });
+			if (!failedLoads.empty())
+			{
+				m_generateThread.BeginRegistering();
+				for (RegionCoordinate coordinate : failedLoads)
+				{
+					m_prefetchesInProgress.erase(coordinate);
+					
+					RegionEntry* regionEntry = RegionEntryFromGlobalCoordinate(coordinate);
+					if (regionEntry != nullptr && regionEntry->m_region == nullptr)
+					{
+						regionEntry->m_generateCancelToken = m_generateThread.Register(coordinate);
+					}
+				}
+				m_generateThread.EndRegistering();
+			}
+			
+			SetProfilingCounter("IO Loads Queued", static_cast<float>(m_ioThread->GetNumQueuedLoads()));
+			SetProfilingCounter("IO Saves Queued", static_cast<float>(m_ioThread->GetNumQueuedSaves()));
 		}
 		
 		if (m_generateThread.IterateGeneratedRegions(ProcessNewRegion))
@@ -204,26 +309,32 @@ namespace MCR
 			m_generateThread.ProcessFutureRegions(*this);
 		}
 		
-		const glm::ivec2 regionNeighborDirs[] = 
-		{
-			/* NeighborPosX */  {  1, 0 },
-			/* NeighborNegX */  { -1, 0 },
-			/* NeighborPosZ */  { 0,  1 },
-			/* NeighborNegZ */  { 0, -1 }
-		};
+		const NoiseTileCache& noiseTiles = m_generateThread.GetGenerator().GetNoiseTileCache();
+		const uint64_t noiseTileLookups = noiseTiles.GetHits() + noiseTiles.GetMisses();
+		SetProfilingCounter("Noise Tile Cache Hit Rate", noiseTileLookups == 0 ? 0.0f :
+		                    static_cast<float>(noiseTiles.GetHits()) / noiseTileLookups);
 		
 		//Processes built regions
-		m_chunkBuildThread.IterateCompleted([&] (int64_t x, int64_t y, int64_t z, ChunkMesh& mesh)
+		m_chunkBuildThread.IterateCompleted([&] (int64_t x, int64_t y, int64_t z, uint64_t version, ChunkMesh& mesh)
 		{
 			int localX = gsl::narrow<int>(x - m_centerRegionX) + m_loadDistance;
 			int localZ = gsl::narrow<int>(z - m_centerRegionZ) + m_loadDistance;
 			int regTableIndex = GetRegionIndex(localX, localZ);
 			
-			RegionEntry* regionEntry = regTableIndex == -1 ? nullptr : m_regions[0][regTableIndex];
+			RegionEntry* regionEntry = regTableIndex == -1 ? nullptr : m_regions[regTableIndex];
 			
-			if (regionEntry != nullptr)
+			//Meshes of chunks which have been released while they were being built are discarded.
+			if (regionEntry != nullptr && regionEntry->m_meshesRequested[y])
 			{
 				regionEntry->m_state = RegionStates::Built;
+				
+				//Meshes built from chunks which have been modified since are discarded and built again.
+				if (version != GetMeshInputVersion(localX, localZ, static_cast<uint32_t>(y)))
+				{
+					regionEntry->m_meshesOutOfDate.set(y);
+					return;
+				}
+				
 				regionEntry->m_meshes[y] = std::move(mesh);
 			}
 		});
@@ -241,19 +352,33 @@ namespace MCR
 		bool buildThreadUpdating = false;
 		
 		//Updates the build thread's camera region
-		if (shifted)
+		if (shifted || currentChunkY != m_cameraChunkY)
 		{
 			m_chunkBuildThread.BeginUpdating();
 			m_chunkBuildThread.SetCameraPosition(currentRegionX, currentChunkY, currentRegionZ);
 			buildThreadUpdating = true;
+			m_cameraChunkY = currentChunkY;
 		}
 		
+		//Checks if a chunk should have a mesh. Chunks above the highest block of the region are empty, and buried
+		//chunks only get a mesh when they are near the camera if vertical streaming is enabled. extraDistance is
+		//used to keep meshes for a bit longer than needed, so they aren't rebuilt when the camera moves back and forth.
+		auto ShouldHaveChunkMesh = [&] (uint32_t y, int maxNonAirY, int numBuriedChunks, int extraDistance)
+		{
+			const int chunkY = static_cast<int>(y);
+			if (chunkY * Region::Size > maxNonAirY)
+				return false;
+			if (!m_verticalStreaming || chunkY >= numBuriedChunks)
+				return true;
+			return std::abs(chunkY - currentChunkY) <= m_verticalStreamingDistance + extraDistance;
+		};
+		
 		//Manages the building of meshes.
 		for (int x = 0; x < m_regionTableSize; x++)
 		{
 			for (int z = 0; z < m_regionTableSize; z++)
 			{
-				RegionEntry* region = m_regions[0][GetRegionIndex(x, z)];
+				RegionEntry* region = m_regions[GetRegionIndex(x, z)];
 				if (region == nullptr) //This probably never happens...
 					continue;
 				
@@ -264,34 +389,32 @@ namespace MCR
 				
 				if (shouldHaveMesh)
 				{
-					if (region->m_state == RegionStates::LoadedNotBuilt)
+					if (region->m_state != RegionStates::Loading)
 					{
-						//This region is loaded and within range to have a mesh, but it doesn't have one
-						//(this happens to regions that have just been loaded) so a build command should be submitted
-						//to the build thread.
+						//Submits build commands to the build thread for chunks which should have a mesh but don't
+						//(this happens to regions that have just been loaded), and releases the meshes of chunks
+						//which no longer need one.
+						const int maxNonAirY = region->m_region->GetMaxNonAirY();
+						const int numBuriedChunks = m_verticalStreaming ? GetNumBuriedChunks(x, z) : 0;
 						
-						ChunkBuildThread::BuildCommand buildCommand;
-						
-						bool allNeighborsLoaded = true;
-						for (int i = 0; i < 4; i++)
+						for (uint32_t y = 0; y < Region::ChunkCount; y++)
 						{
-							int neighborRegIndex = GetRegionIndex(x + regionNeighborDirs[i].x,
-							                                      z + regionNeighborDirs[i].y);
-							if (neighborRegIndex == -1 || !m_regions[0][neighborRegIndex]->m_region)
+							if (region->m_meshesRequested[y])
 							{
-								allNeighborsLoaded = false;
-								break;
+								if (!ShouldHaveChunkMesh(y, maxNonAirY, numBuriedChunks, 1))
+								{
+									region->m_meshes[y].Reset();
+									region->m_meshesRequested.reset(y);
+								}
+								continue;
 							}
-							else
+							
+							ChunkBuildThread::BuildCommand buildCommand;
+							if (!ShouldHaveChunkMesh(y, maxNonAirY, numBuriedChunks, 0) ||
+							    !MakeBuildCommand(x, z, y, buildCommand))
 							{
-								buildCommand.m_neighbors[i] = m_regions[0][neighborRegIndex]->m_region;
+								continue;
 							}
-						}
-						
-						if (allNeighborsLoaded)
-						{
-							buildCommand.m_coordinate = { region->m_region->GetX(), region->m_region->GetZ() };
-							buildCommand.m_region = region->m_region;
 							
 							if (!buildThreadUpdating)
 							{
@@ -299,16 +422,18 @@ namespace MCR
 								buildThreadUpdating = true;
 							}
 							
-							for (uint32_t y = 0; y < Region::ChunkCount; y++)
-							{
-								buildCommand.m_chunkY = y;
-								m_chunkBuildThread.BuildASync(buildCommand);
-							}
+							m_chunkBuildThread.BuildASync(std::move(buildCommand));
+							region->m_meshesRequested.set(y);
 							
-							region->m_state = RegionStates::Building;
+							if (region->m_state == RegionStates::LoadedNotBuilt)
+								region->m_state = RegionStates::Building;
 						}
+						
+						//Chunks without a mesh are built when they are requested, so they are never out of date.
+						region->m_meshesOutOfDate &= region->m_meshesRequested;
 					}
-					else if (region->m_state == RegionStates::Built && region->m_meshesOutOfDate.any())
+					
+					if (region->m_state == RegionStates::Built && region->m_meshesOutOfDate.any())
 					{
 						for (uint32_t y = 0; y < Region::ChunkCount; y++)
 						{
@@ -340,6 +465,7 @@ namespace MCR
 					}
 					
 					region->m_meshesOutOfDate = { };
+					region->m_meshesRequested = { };
 					region->m_state = RegionStates::LoadedNotBuilt;
 				}
 			}
@@ -350,24 +476,141 @@ namespace MCR
 			m_chunkBuildThread.EndUpdating();
 		}
 		
-		//If any already built chunks were out of date, builds the selected one and starts uploading it.
-		if (chunkToBuild.distToCameraSq != std::numeric_limits<int>::max())
+		//If any already built chunks were out of date, builds the selected one and starts uploading it. The chunk stays
+		//out of date if a neighboring region isn't loaded, like in the asynchronous path.
+		ChunkBuildThread::BuildCommand buildCommand;
+		if (chunkToBuild.distToCameraSq != std::numeric_limits<int>::max() &&
+		    MakeBuildCommand(chunkToBuild.x, chunkToBuild.z, chunkToBuild.y, buildCommand))
 		{
-			RegionEntry* region = m_regions[0][GetRegionIndex(chunkToBuild.x, chunkToBuild.z)];
+			RegionEntry* region = m_regions[GetRegionIndex(chunkToBuild.x, chunkToBuild.z)];
 			
 			region->m_state = RegionStates::Uploading;
 			region->m_meshesOutOfDate.reset(chunkToBuild.y);
 			
-			std::array<const Region*, 4> neighbors;
-			for (int n = 0; n < 4; n++)
+			m_chunkBuildThread.BuildSync(buildCommand, m_meshBuilder);
+		}
+	}
+	
+	void WorldManager::SetLoadedRegion(RegionEntry& entry, std::shared_ptr<Region> region)
+	{
+		for (uint32_t i = 0; i < Region::ChunkCount; i++)
+		{
+			if (region->ChunkHasWater(i))
+			{
+				m_outOfDateWaterList.push_back({ { region->GetX(), region->GetZ() }, i });
+			}
+		}
+		
+		entry.m_state = RegionStates::LoadedNotBuilt;
+		entry.m_region = std::move(region);
+	}
+	
+	void WorldManager::UpdatePrefetch(bool shifted)
+	{
+		const glm::vec3 predictedPosition = m_camera.GetPosition() + m_camera.GetVelocity() * prefetchSeconds;
+		auto PredictRegion = [&] (float position, int64_t centerRegion)
+		{
+			return glm::clamp(static_cast<int64_t>(std::floor(position / Region::Size)),
+			                  centerRegion - maxPrefetchDistance, centerRegion + maxPrefetchDistance);
+		};
+		const RegionCoordinate predictedRegion = {
+			PredictRegion(predictedPosition.x, m_centerRegionX),
+			PredictRegion(predictedPosition.z, m_centerRegionZ)
+		};
+		
+		if (!shifted && predictedRegion == m_prefetchRegion)
+			return;
+		m_prefetchRegion = predictedRegion;
+		
+		auto IsInLoadArea = [&] (RegionCoordinate center, RegionCoordinate coordinate)
+		{
+			return std::abs(coordinate.x - center.x) <= m_loadDistance &&
+			       std::abs(coordinate.z - center.z) <= m_loadDistance;
+		};
+		
+		m_ioThread->BeginRegistering();
+		m_generateThread.BeginRegistering();
+		
+		//Prefetched regions which are no longer expected to enter the loaded area are released like evicted regions.
+		for (auto it = m_prefetchedRegions.begin(); it != m_prefetchedRegions.end();)
+		{
+			if (m_prefetchEnabled && IsInLoadArea(predictedRegion, it->first))
 			{
-				const int nx = chunkToBuild.x + regionNeighborDirs[n].x;
-				const int nz = chunkToBuild.z + regionNeighborDirs[n].y;
-				neighbors[n] = m_regions[0][GetRegionIndex(nx, nz)]->m_region.get();
+				++it;
+				continue;
 			}
 			
-			m_chunkBuildThread.BuildSync(*region->m_region, chunkToBuild.y, neighbors, m_meshBuilder);
+			if (it->second->IsDirty() || m_regionCache.GetCapacity() != 0)
+			{
+				m_ioThread->RegisterForSaving(std::move(it->second), true);
+			}
+			it = m_prefetchedRegions.erase(it);
+		}
+		
+		const RegionCoordinate centerRegion = { m_centerRegionX, m_centerRegionZ };
+		if (m_prefetchEnabled && predictedRegion != centerRegion)
+		{
+			for (int64_t x = predictedRegion.x - m_loadDistance; x <= predictedRegion.x + m_loadDistance; x++)
+			{
+				for (int64_t z = predictedRegion.z - m_loadDistance; z <= predictedRegion.z + m_loadDistance; z++)
+				{
+					const RegionCoordinate coordinate = { x, z };
+					if (IsInLoadArea(centerRegion, coordinate) || m_prefetchedRegions.count(coordinate) != 0 ||
+					    m_prefetchesInProgress.count(coordinate) != 0)
+					{
+						continue;
+					}
+					
+					if (m_ioThread->IsInFlight(coordinate) || m_world->HasRegion(x, z))
+					{
+						m_ioThread->RegisterForPrefetching(coordinate);
+					}
+					else
+					{
+						m_generateThread.RegisterPrefetch(coordinate);
+					}
+					m_prefetchesInProgress.insert(coordinate);
+				}
+			}
+		}
+		
+		m_ioThread->EndRegistering();
+		m_generateThread.EndRegistering();
+	}
+	
+	void WorldManager::UpdateMissingMeshStats(const Frustum& frustum)
+	{
+		int numMissingMeshes = 0;
+		
+		for (int x = 0; x < m_regionTableSize; x++)
+		{
+			for (int z = 0; z < m_regionTableSize; z++)
+			{
+				const int cameraDX = x - m_loadDistance;
+				const int cameraDZ = z - m_loadDistance;
+				if (cameraDX * cameraDX + cameraDZ * cameraDZ >= m_renderDistanceSq)
+					continue;
+				
+				const RegionEntry* region = m_regions[GetRegionIndex(x, z)];
+				if (region != nullptr && (region->m_state == RegionStates::Built ||
+				                          region->m_state == RegionStates::Uploading))
+				{
+					continue;
+				}
+				
+				const RegionCoordinate coordinate = GetWorldRegionCoord(x, z);
+				const AABoundingBox boundingBox(glm::vec3(coordinate.x * Region::Size, 0, coordinate.z * Region::Size),
+				                                glm::vec3((coordinate.x + 1) * Region::Size, Region::Height,
+				                                          (coordinate.z + 1) * Region::Size));
+				if (frustum.Intersects(boundingBox))
+					numMissingMeshes++;
+			}
 		}
+		
+		if (numMissingMeshes != 0)
+			m_numFramesMissingMeshes++;
+		
+		SetProfilingCounter("Visible Regions Without Mesh", static_cast<float>(numMissingMeshes));
 	}
 	
 	WorldManager::MeshRenderInfo WorldManager::GetChunkMeshRenderInfo(int64_t x, int y, int64_t z) const
@@ -383,7 +626,7 @@ namespace MCR
 		if (regionIndex == -1)
 			return info;
 		
-		RegionEntry* region = m_regions[0][regionIndex];
+		RegionEntry* region = m_regions[regionIndex];
 		if (region == nullptr || region->m_region == nullptr)
 			return info;
 		
@@ -421,12 +664,19 @@ namespace MCR
 		{
 			//This span only consists of a single region, add it to the render list if it is in the correct state.
 			
-			RegionEntry* region = m_regions[0][GetRegionIndex(minX, minZ)];
+			RegionEntry* region = m_regions[GetRegionIndex(minX, minZ)];
 			
 			//Not sure if the null check is necessary...
 			if (region != nullptr && (region->m_state == RegionStates::Built ||
 			                          region->m_state == RegionStates::Uploading))
 			{
+				//Tests the region again, with the bounding box limited to the height of the highest block.
+				const float maxY = static_cast<float>(region->m_region->GetMaxNonAirY() + 1);
+				const AABoundingBox regionBoundingBox(boundingBox.MinPos(), { boundingBox.MaxPos().x, maxY,
+				                                                              boundingBox.MaxPos().z });
+				if (!frustum.Intersects(regionBoundingBox))
+					return;
+				
 				for (ChunkMesh& mesh : region->m_meshes)
 				{
 					if (mesh.HasData())
@@ -466,7 +716,100 @@ namespace MCR
 		const int index = GetRegionIndex(static_cast<int>(coordinate.x - m_centerRegionX + m_loadDistance),
 		                                 static_cast<int>(coordinate.z - m_centerRegionZ + m_loadDistance));
 		
-		return index == -1 ? nullptr : m_regions[0][index];
+		return index == -1 ? nullptr : m_regions[index];
+	}
+	
+	const Region* WorldManager::GetLoadedRegion(int x, int z) const
+	{
+		const int index = GetRegionIndex(x, z);
+		if (index == -1 || m_regions[index] == nullptr)
+			return nullptr;
+		return m_regions[index]->m_region.get();
+	}
+	
+	bool WorldManager::MakeBuildCommand(int x, int z, uint32_t chunkY,
+	                                    ChunkBuildThread::BuildCommand& buildCommand) const
+	{
+		const Region* region = GetLoadedRegion(x, z);
+		if (region == nullptr)
+			return false;
+		
+		for (int i = 0; i < 4; i++)
+		{
+			const Region* neighbor = GetLoadedRegion(x + regionNeighborDirs[i].x, z + regionNeighborDirs[i].y);
+			if (neighbor == nullptr)
+				return false;
+			buildCommand.m_neighbors[i] = neighbor->GetChunkSnapshot(chunkY);
+		}
+		
+		buildCommand.m_coordinate = { region->GetX(), region->GetZ() };
+		buildCommand.m_chunkY = chunkY;
+		buildCommand.m_chunk = region->GetChunkSnapshot(chunkY);
+		buildCommand.m_chunkAbove = chunkY + 1 < Region::ChunkCount ? region->GetChunkSnapshot(chunkY + 1) : nullptr;
+		buildCommand.m_chunkBelow = chunkY > 0 ? region->GetChunkSnapshot(chunkY - 1) : nullptr;
+		buildCommand.m_version = GetMeshInputVersion(x, z, chunkY);
+		
+		return true;
+	}
+	
+	int WorldManager::GetNumBuriedChunks(int x, int z) const
+	{
+		const Region* region = GetLoadedRegion(x, z);
+		if (region == nullptr)
+			return 0;
+		
+		int minSolidY = region->GetMinSolidY();
+		for (const glm::ivec2& neighborDir : regionNeighborDirs)
+		{
+			const Region* neighbor = GetLoadedRegion(x + neighborDir.x, z + neighborDir.y);
+			if (neighbor == nullptr)
+				return 0;
+			minSolidY = std::min(minSolidY, neighbor->GetMinSolidY());
+		}
+		
+		return std::max(minSolidY, 0) / Region::Size;
+	}
+	
+	int WorldManager::GetNumChunkMeshes() const
+	{
+		int numChunkMeshes = 0;
+		for (const RegionEntry* entry : m_regions)
+		{
+			if (entry == nullptr)
+				continue;
+			
+			for (const ChunkMesh& mesh : entry->m_meshes)
+			{
+				if (mesh.HasData())
+					numChunkMeshes++;
+			}
+		}
+		return numChunkMeshes;
+	}
+	
+	uint64_t WorldManager::GetMeshInputVersion(int x, int z, uint32_t chunkY) const
+	{
+		//Chunks get a version higher than all existing versions when they are modified after a snapshot has been
+		//taken, so the highest version of the input chunks changes whenever any of them is modified.
+		const Region* region = GetLoadedRegion(x, z);
+		if (region == nullptr)
+			return 0;
+		
+		uint64_t version = region->GetChunkVersion(chunkY);
+		if (chunkY + 1 < Region::ChunkCount)
+			version = std::max(version, region->GetChunkVersion(chunkY + 1));
+		if (chunkY > 0)
+			version = std::max(version, region->GetChunkVersion(chunkY - 1));
+		
+		for (const glm::ivec2& neighborDir : regionNeighborDirs)
+		{
+			const Region* neighbor = GetLoadedRegion(x + neighborDir.x, z + neighborDir.y);
+			if (neighbor == nullptr)
+				return 0;
+			version = std::max(version, neighbor->GetChunkVersion(chunkY));
+		}
+		
+		return version;
 	}
 	
 	WorldManager::RegionEntry* WorldManager::AllocateRegionEntry()
@@ -485,21 +828,28 @@ namespace MCR
 	
 	void WorldManager::FreeRegionEntry(WorldManager::RegionEntry* entry)
 	{
+		//Regions which leave the loaded area before being generated aren't needed anymore.
+		if (entry->m_generateCancelToken != nullptr)
+		{
+			entry->m_generateCancelToken->store(true, std::memory_order_relaxed);
+		}
+		
 		*entry = RegionEntry();
 		m_availableRegions.push_back(entry);
 	}
 	
 	void WorldManager::SetWorld(std::unique_ptr<World> world)
 	{
+		//The IO threads are stopped before the world they use is destroyed.
+		m_ioThread = nullptr;
 		m_world = std::move(world);
+		m_regionCache.Clear();
+		m_prefetchesInProgress.clear();
+		m_prefetchedRegions.clear();
 		
-		if (m_world == nullptr)
+		if (m_world != nullptr)
 		{
-			m_ioThread = nullptr;
-		}
-		else
-		{
-			m_ioThread = std::make_unique<RegionIOThread>(*m_world);
+			m_ioThread = std::make_unique<RegionIOThread>(numIOThreads, *m_world, m_regionPool, m_regionCache);
 		}
 	}
 	
@@ -544,6 +894,24 @@ namespace MCR
 		m_outOfDateWaterList.clear();
 	}
 	
+	size_t WorldManager::GetRegionMemoryUsage(size_t& denseBytes) const
+	{
+		size_t bytes = 0;
+		denseBytes = 0;
+		
+		for (const RegionEntry* entry : m_regions)
+		{
+			if (entry == nullptr || entry->m_region == nullptr)
+				continue;
+			
+			bytes += entry->m_region->GetMemoryUsage();
+			denseBytes += sizeof(Region) + (sizeof(Region::Chunk) - sizeof(ChunkStorage)) * Region::ChunkCount +
+			              Region::DataBufferBytes;
+		}
+		
+		return bytes;
+	}
+	
 	bool WorldManager::IsCameraUnderWater(float& waterPlaneY) const
 	{
 		int64_t cameraChunkX = static_cast<int64_t>(std::floor(m_camera.GetPosition().x / Region::Size));
@@ -560,13 +928,17 @@ namespace MCR
 		glm::ivec3 localCameraPosI(cameraPosI.x - (cameraChunkX * Region::Size), cameraPosI.y,
 		                           cameraPosI.z - (cameraChunkZ * Region::Size));
 		
-		if (region->Get(localCameraPosI.x, localCameraPosI.y, localCameraPosI.z).m_id != BlockIDs::Water)
+		const int maxNonAirY = region->GetMaxNonAirY(localCameraPosI.x, localCameraPosI.z);
+		if (localCameraPosI.y > maxNonAirY ||
+		    !region->IsBlockWater(localCameraPosI.x, localCameraPosI.y, localCameraPosI.z))
+		{
 			return false;
+		}
 		
+		//There is no water above the highest non air block, so the search can stop there.
 		for (int y = localCameraPosI.y; ; y++)
 		{
-			if (y >= Region::Height - 1 ||
-				region->Get(localCameraPosI.x, y + 1, localCameraPosI.z).m_id != BlockIDs::Water)
+			if (y >= maxNonAirY || !region->IsBlockWater(localCameraPosI.x, y + 1, localCameraPosI.z))
 			{
 				waterPlaneY = static_cast<float>(y) + WaterMesh::WaterHeight;
 				break;
@@ -7,12 +7,17 @@
 #include <queue>
 #include <atomic>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <cstdint>
 #include <bitset>
+#include <algorithm>
 
 #include "chunkbuildthread.h"
 #include "regiongeneratethread.h"
 #include "regioniothread.h"
+#include "regionpool.h"
+#include "regioncache.h"
 #include "world.h"
 #include "camera.h"
 #include "../rendering/regions/watermesh.h"
@@ -68,6 +73,99 @@ namespace MCR
 		
 		bool IsCameraUnderWater(float& waterPlaneY) const;
 		
+		//Returns the number of bytes used by all loaded regions. denseBytes is set to the number of bytes the same
+		//regions would use if their blocks were stored without palette compression.
+		size_t GetRegionMemoryUsage(size_t& denseBytes) const;
+		
+		inline const RegionPool& GetRegionPool() const
+		{
+			return m_regionPool;
+		}
+		
+		//Evicted regions are kept in the region cache (compressed) until it is full, so that they can be restored
+		//without reading them from disk.
+		inline RegionCache& GetRegionCache()
+		{
+			return m_regionCache;
+		}
+		
+		//Returns null if no world is set.
+		inline const RegionIOThread* GetIOThread() const
+		{
+			return m_ioThread.get();
+		}
+		
+		inline WorldGenerator& GetGenerator()
+		{
+			return m_generateThread.GetGenerator();
+		}
+		
+		inline RegionGenerateThread& GetGenerateThread()
+		{
+			return m_generateThread;
+		}
+		
+		//When vertical streaming is enabled, chunks which are buried below the terrain are only meshed once the camera
+		//is within the vertical streaming distance (in chunks) of them, and their meshes are released again when the
+		//camera moves away. Other chunks are always meshed.
+		inline void SetVerticalStreaming(bool verticalStreaming)
+		{
+			m_verticalStreaming = verticalStreaming;
+		}
+		
+		inline bool IsVerticalStreamingEnabled() const
+		{
+			return m_verticalStreaming;
+		}
+		
+		inline void SetVerticalStreamingDistance(int distance)
+		{
+			m_verticalStreamingDistance = distance;
+		}
+		
+		inline int GetVerticalStreamingDistance() const
+		{
+			return m_verticalStreamingDistance;
+		}
+		
+		//Returns the number of chunks which currently have a mesh with data.
+		int GetNumChunkMeshes() const;
+		
+		//When prefetching is enabled, regions which are expected to enter the loaded area soon based on the camera's
+		//velocity are loaded or generated before they are needed, at a lower priority than other regions.
+		inline void SetPrefetchEnabled(bool prefetchEnabled)
+		{
+			m_prefetchEnabled = prefetchEnabled;
+		}
+		
+		inline bool IsPrefetchEnabled() const
+		{
+			return m_prefetchEnabled;
+		}
+		
+		//The number of regions which have been prefetched and are waiting to enter the loaded area.
+		inline size_t GetNumPrefetchedRegions() const
+		{
+			return m_prefetchedRegions.size();
+		}
+		
+		//The number of regions entering the loaded area which had already been loaded or generated by a prefetch, or
+		//were being prefetched when they entered it.
+		inline uint64_t GetNumPrefetchHits() const
+		{
+			return m_numPrefetchHits;
+		}
+		
+		//Checks if any region in the frustum and within the render distance doesn't have its meshes yet. Should be
+		//called once per frame.
+		void UpdateMissingMeshStats(const class Frustum& frustum);
+		
+		//The number of frames in which a visible region was missing its meshes, see UpdateMissingMeshStats.
+		inline uint64_t GetNumFramesMissingMeshes() const
+		{
+			return m_numFramesMissingMeshes;
+		}
+		
 	private:
 		void FillRenderListR(class ChunkRenderList& renderList, const class Frustum& frustum,
 		                     int minX, int minZ, int spanX, int spanZ) const;
@@ -80,13 +178,46 @@ namespace MCR
 			};
 		}
 		
+		//Returns the index of a region in the region table, from its coordinate relative to the corner of the loaded
+		//area. The table is a ring addressed by the global region coordinate modulo the table size, so regions keep
+		//their slot when the loaded area moves and only the regions entering or leaving it need to be updated.
 		inline int GetRegionIndex(int x, int z) const
 		{
 			if (x < 0 || z < 0 || x >= m_regionTableSize || z >= m_regionTableSize)
 				return -1;
-			return z + x * m_regionTableSize;
+			return WrapRingCoordinate(z + m_ringOffsetZ) + WrapRingCoordinate(x + m_ringOffsetX) * m_regionTableSize;
+		}
+		
+		inline int WrapRingCoordinate(int coordinate) const
+		{
+			return coordinate >= m_regionTableSize ? coordinate - m_regionTableSize : coordinate;
 		}
 		
+		//Calls the callback with the coordinate of every region which is moved off the region table when the loaded
+		//area is shifted by the given amount. Only visits the affected rows and columns.
+		template <typename CallbackTp>
+		void ForEachShiftedOff(int shiftX, int shiftZ, CallbackTp callback) const
+		{
+			const int stripBeginZ = shiftZ > 0 ? std::max(m_regionTableSize - shiftZ, 0) : 0;
+			const int stripEndZ = shiftZ > 0 ? m_regionTableSize : std::min(-shiftZ, m_regionTableSize);
+			
+			for (int x = 0; x < m_regionTableSize; x++)
+			{
+				const bool columnShiftedOff = x + shiftX < 0 || x + shiftX >= m_regionTableSize;
+				const int beginZ = columnShiftedOff ? 0 : stripBeginZ;
+				const int endZ = columnShiftedOff ? m_regionTableSize : stripEndZ;
+				
+				for (int z = beginZ; z < endZ; z++)
+				{
+					callback(x, z);
+				}
+			}
+		}
+		
+		//Declared before the threads using them, so that they outlive them.
+		RegionPool m_regionPool;
+		RegionCache m_regionCache;
+		
 		std::unique_ptr<RegionIOThread> m_ioThread;
 		
 		RegionGenerateThread m_generateThread;
@@ -105,12 +236,39 @@ namespace MCR
 			RegionStates m_state;
 			std::shared_ptr<Region> m_region;
 			std::bitset<Region::ChunkCount> m_meshesOutOfDate;
+			std::bitset<Region::ChunkCount> m_meshesRequested; //Chunks which have a mesh or are being built
 			std::array<ChunkMesh, Region::ChunkCount> m_meshes; //Performance improvement: don't allocate statically (faster move).
 			std::array<WaterMesh, Region::ChunkCount> m_waterMeshes;
+			
+			//Cancels generation of the region if it is still waiting to be generated.
+			RegionGenerateThread::CancelToken m_generateCancelToken;
 		};
 		
 		RegionEntry* RegionEntryFromGlobalCoordinate(RegionCoordinate coordinate);
 		
+		//Hands a loaded or generated region to its entry in the region table.
+		void SetLoadedRegion(RegionEntry& entry, std::shared_ptr<Region> region);
+		
+		//Extrapolates the camera's position and prefetches the regions around it which aren't loaded. Releases
+		//prefetched regions which are no longer expected to be needed. Only does anything if the predicted region
+		//has changed or the loaded area has moved.
+		void UpdatePrefetch(bool shifted);
+		
+		//Returns the region at a position in the region table relative to the corner of the loaded area, or null if
+		//the position is outside the table or the region hasn't been loaded.
+		const Region* GetLoadedRegion(int x, int z) const;
+		
+		//Fills a build command with snapshots of a chunk and the chunks around it, x and z are relative to the corner
+		//of the loaded area. Returns false if a neighboring region isn't loaded.
+		bool MakeBuildCommand(int x, int z, uint32_t chunkY, ChunkBuildThread::BuildCommand& buildCommand) const;
+		
+		//Returns the version a mesh built from the current contents of a chunk would get, see MakeBuildCommand.
+		uint64_t GetMeshInputVersion(int x, int z, uint32_t chunkY) const;
+		
+		//Returns the number of chunks at the bottom of a region which are below the highest opaque block of every
+		//column in the region and its neighbors, so they can only be seen from inside caves.
+		int GetNumBuriedChunks(int x, int z) const;
+		
 		RegionEntry* AllocateRegionEntry();
 		void FreeRegionEntry(RegionEntry* entry);
 		
@@ -120,12 +278,34 @@ namespace MCR
 		
 		int64_t m_centerRegionX = 0;
 		int64_t m_centerRegionZ = 0;
+		
+		//Ring table slot of the corner of the loaded area along each axis.
+		int m_ringOffsetX = 0;
+		int m_ringOffsetZ = 0;
+		
 		bool m_hasUpdated = false;
 		
+		int64_t m_cameraChunkY = 0;
+		
+		bool m_verticalStreaming = false;
+		int m_verticalStreamingDistance = 2;
+		
+		bool m_prefetchEnabled = true;
+		
+		//The region the camera is predicted to be in, regions within the load distance of it are prefetched.
+		RegionCoordinate m_prefetchRegion = { 0, 0 };
+		
+		//Regions which have been registered for prefetching but haven't been returned by the IO or generate threads.
+		std::unordered_set<RegionCoordinate, RegionCoordinateHash> m_prefetchesInProgress;
+		std::unordered_map<RegionCoordinate, std::shared_ptr<Region>, RegionCoordinateHash> m_prefetchedRegions;
+		
+		uint64_t m_numPrefetchHits = 0;
+		uint64_t m_numFramesMissingMeshes = 0;
+		
 		std::unique_ptr<RegionEntry[]> m_regionsAllocation;
 		std::vector<RegionEntry*> m_availableRegions;
 		
-		std::vector<RegionEntry*> m_regions[2];
+		std::vector<RegionEntry*> m_regions;
 		
 		struct OutOfDateWaterMesh
 		{